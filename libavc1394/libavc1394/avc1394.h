@@ -24,6 +24,7 @@
 
 
 #include <libraw1394/raw1394.h>
+#include <time.h>
 
 /* AV/C response codes */
 #define AVC1394_RESPONSE_NOT_IMPLEMENTED 0x08000000
@@ -189,6 +190,14 @@
 
 #define AVC1394_OPERAND_UNIT_INFO_EXTENSION_CODE 7
 
+/* DIGITAL INPUT and DIGITAL OUTPUT operands */
+#define AVC1394_OPERAND_DIGITAL_ESTABLISH 0x70
+#define AVC1394_OPERAND_DIGITAL_BREAK 0x60
+#define AVC1394_OPERAND_DIGITAL_STATUS 0xFF
+
+/* subunit_type and id, or plug, of a connection end at the unit itself */
+#define AVC1394_CONNECTION_UNIT 0xFF
+
 /* AV/C Common unit and subunit command operands */
 #define AVC1394_OPERAND_DESCRIPTOR_TYPE_SUBUNIT_IDENTIFIER_DESCRIPTOR 0x00
 #define AVC1394_OPERAND_DESCRIPTOR_TYPE_OBJECT_LIST_DESCRIPTOR_ID 0x10
@@ -198,6 +207,13 @@
 #define AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_CLOSE 0x00
 #define AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_READ_OPEN 0x01
 #define AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_WRITE_OPEN 0x03
+#define AVC1394_OPERAND_SEARCH_DIRECTION_FORWARD 0x10
+#define AVC1394_OPERAND_SEARCH_DIRECTION_BACKWARD 0x11
+#define AVC1394_OPERAND_SEARCH_RESPONSE_SPECIFIER 0x00
+#define AVC1394_OPERAND_OBJECT_NUMBER_SELECT_NEW 0xD0
+#define AVC1394_OPERAND_OBJECT_NUMBER_SELECT_ADD 0xD1
+#define AVC1394_OPERAND_OBJECT_NUMBER_SELECT_REPLACE 0xD2
+#define AVC1394_OPERAND_OBJECT_NUMBER_SELECT_CLEAR 0xD3
 
 /* VCR subunit commands (Alphabetically) */
 #define AVC1394_VCR_COMMAND_ANALOG_AUDIO_OUTPUT_MODE 0x000007000
@@ -424,6 +440,7 @@
 #define AVC1394_PANEL_OPERATION_BACKWARD 0x49
 #define AVC1394_PANEL_OPERATION_ANGLE 0x50
 #define AVC1394_PANEL_OPERATION_SUBPICTURE 0x51
+#define AVC1394_PANEL_OPERATION_TUNE_FUNCTION 0x67
 
 
 enum avc1394_measurement_unit {
@@ -462,6 +479,206 @@ avc1394_transaction_block(raw1394handle_t handle, nodeid_t node,
 void 
 avc1394_transaction_block_close(raw1394handle_t handle);
 
+/* Command types and response codes as avc1394_decode_ctype() and
+   avc1394_decode_response() report them */
+enum avc1394_ctype_id {
+	AVC1394_CT_UNKNOWN,
+	AVC1394_CT_CONTROL,
+	AVC1394_CT_STATUS,
+	AVC1394_CT_SPECIFIC_INQUIRY,
+	AVC1394_CT_NOTIFY,
+	AVC1394_CT_GENERAL_INQUIRY
+};
+
+enum avc1394_response_id {
+	AVC1394_RC_UNKNOWN,
+	AVC1394_RC_NOT_IMPLEMENTED,
+	AVC1394_RC_ACCEPTED,
+	AVC1394_RC_REJECTED,
+	AVC1394_RC_IN_TRANSITION,
+	AVC1394_RC_STABLE,		/* also IMPLEMENTED */
+	AVC1394_RC_CHANGED,
+	AVC1394_RC_INTERIM
+};
+
+/* decode the first quadlet of a request or response by table lookup */
+enum avc1394_ctype_id
+avc1394_decode_ctype(quadlet_t request);
+
+enum avc1394_response_id
+avc1394_decode_response(quadlet_t response);
+
+/* names for logs and debug output */
+const char *
+avc1394_ctype_name(enum avc1394_ctype_id ctype);
+
+const char *
+avc1394_response_name(enum avc1394_response_id response);
+
+/* Largest FCP frame */
+#define AVC1394_FRAME_MAX 512
+
+/*
+ * A command or response of any length up to AVC1394_FRAME_MAX, looked at
+ * in wire order where it lies. The avc1394_frame_... accessors check every
+ * read against length and every write against size.
+ */
+typedef struct avc1394_frame_struct {
+	unsigned char	*data;
+	unsigned int	length;		/* bytes of frame in data */
+	unsigned int	size;		/* bytes data can hold */
+} avc1394_frame;
+
+/* look at length bytes at data, which has room for size; returns -1 if
+   that is no AV/C frame */
+int
+avc1394_frame_init(avc1394_frame *frame, unsigned char *data,
+	unsigned int length, unsigned int size);
+
+/* the ctype of a command or the code of a response */
+int
+avc1394_frame_ctype(const avc1394_frame *frame);
+
+/* AVC1394_SUBUNIT_TYPE_... >> 19 */
+int
+avc1394_frame_subunit_type(const avc1394_frame *frame);
+
+int
+avc1394_frame_subunit_id(const avc1394_frame *frame);
+
+int
+avc1394_frame_opcode(const avc1394_frame *frame);
+
+int
+avc1394_frame_operand_count(const avc1394_frame *frame);
+
+/* operand n, or -1 past the end */
+int
+avc1394_frame_operand(const avc1394_frame *frame, int n);
+
+/* len operands from offset, in place; NULL past the end */
+unsigned char *
+avc1394_frame_operands(const avc1394_frame *frame, int offset, int len);
+
+/* these return -1 if the frame has no room */
+int
+avc1394_frame_set_ctype(avc1394_frame *frame, int ctype);
+
+/* sets operand n, lengthening the frame with zeros to reach it */
+int
+avc1394_frame_set_operand(avc1394_frame *frame, int n, unsigned char value);
+
+/* cut or zero pad the frame to count operands */
+int
+avc1394_frame_set_operand_count(avc1394_frame *frame, int count);
+
+/*
+ * Non-blocking transactions. Start one or more requests, possibly to
+ * different nodes, then poll for their responses. The blocking transaction
+ * functions may be used on the same handle meanwhile; responses meant for
+ * outstanding transactions still reach them.
+ */
+typedef struct avc1394_pending_struct avc1394_pending;
+
+/* returns NULL if the request could not be sent */
+avc1394_pending *
+avc1394_transaction_start(raw1394handle_t handle, nodeid_t node,
+	quadlet_t *request, int len);
+
+/* wait up to timeout ms for the final response; returns 1 when it arrived.
+   For a NOTIFY that is the CHANGED response (or an immediate rejection). */
+int
+avc1394_transaction_poll(avc1394_pending *pending, int timeout);
+
+/* block for the final response; returns its AVC1394_RESP_... code or -1 */
+int
+avc1394_transaction_wait(avc1394_pending *pending);
+
+/* the final response in host byte order, NULL while there is none */
+quadlet_t *
+avc1394_transaction_response(avc1394_pending *pending,
+	unsigned int *response_len);
+
+/* look at the final response in place, as received; returns -1 if it
+   has not arrived. It lasts until the transaction is finished. */
+int
+avc1394_transaction_frame(avc1394_pending *pending, avc1394_frame *frame);
+
+/* send a request frame; returns NULL if it could not be sent */
+avc1394_pending *
+avc1394_transaction_start_frame(raw1394handle_t handle, nodeid_t node,
+	const avc1394_frame *request);
+
+/* us from sending the request to its final response, -1 while there is none */
+long
+avc1394_transaction_latency(avc1394_pending *pending);
+
+/* releases the transaction and its response */
+void
+avc1394_transaction_finish(avc1394_pending *pending);
+
+/*
+ * Sequencer: dispatch a batch of commands, possibly to several devices on
+ * several ports, each at its scheduled time. All transactions are set up
+ * before the first dispatch, so commands due at the same time go out back
+ * to back.
+ */
+typedef struct avc1394_sequence_entry_struct {
+	raw1394handle_t	handle;
+	nodeid_t	node;
+	quadlet_t	*request;	/* host byte order */
+	int		len;		/* in quadlets */
+	struct timespec	at;		/* CLOCK_MONOTONIC dispatch time */
+	/* filled in by avc1394_sequence_run() */
+	long		skew;		/* us dispatched after at */
+	long		latency;	/* us from dispatch to response, or -1 */
+	int		response;	/* AVC1394_RESP_... or -1 */
+} avc1394_sequence_entry;
+
+/* set at to ms milliseconds from now on the sequencer clock */
+void
+avc1394_sequence_time(struct timespec *at, long ms);
+
+/* Dispatch the entries in time order, then wait up to timeout ms for their
+   responses. Returns the number of entries that got no response, or -1 if
+   memory ran out before anything was sent. */
+int
+avc1394_sequence_run(avc1394_sequence_entry *entries, int count, int timeout);
+
+/* Widths in bytes of the fields of a subunit's descriptor specifiers */
+typedef struct avc1394_descriptor_sizes_struct {
+	int		list_id;
+	int		object_id;
+	int		object_position;
+} avc1394_descriptor_sizes;
+
+/* the longest descriptor_specifier avc1394_descriptor_specifier() builds */
+#define AVC1394_DESCRIPTOR_SPECIFIER_MAX 17
+
+/* Take the field widths from length bytes of a subunit identifier
+   descriptor. Returns 0, or -1 if it is too short. */
+int
+avc1394_descriptor_sizes_parse(unsigned char *identifier, int length,
+	avc1394_descriptor_sizes *sizes);
+
+/* Encode a descriptor_specifier of one of the
+   AVC1394_OPERAND_DESCRIPTOR_TYPE_... types into specifier, which must
+   hold AVC1394_DESCRIPTOR_SPECIFIER_MAX bytes:
+     SUBUNIT_IDENTIFIER_DESCRIPTOR        nothing else
+     OBJECT_LIST_DESCRIPTOR_ID            id is the list_ID
+     OBJECT_LIST_DESCRIPTOR_TYPE          id is the list_type
+     OBJECT_ENTRY_DESCRIPTOR_POSITION     id is the list_ID, and position
+     OBJECT_ENTRY_DESCRIPTOR_ID           id is the object_ID
+   sizes may be NULL for the first and third. Returns the length of the
+   specifier, or -1 for an unknown type or a field wider than 8 bytes.
+   The result is what the descriptor functions take as
+   descriptor_identifier. */
+int
+avc1394_descriptor_specifier(unsigned char *specifier,
+	const avc1394_descriptor_sizes *sizes, unsigned char type,
+	unsigned long long id, unsigned long long position);
+
+/* descriptor_identifier is the complete descriptor_specifier */
 int 
 avc1394_open_descriptor(raw1394handle_t handle, nodeid_t node,
 	quadlet_t ctype, quadlet_t subunit,
@@ -473,6 +690,483 @@ avc1394_close_descriptor(raw1394handle_t handle, nodeid_t node,
 	quadlet_t ctype, quadlet_t subunit,
 	unsigned char *descriptor_identifier, int len_descriptor_identifier);
 
+/* reads kept in flight by avc1394_descriptor_read() */
+#define AVC1394_DESCRIPTOR_PIPELINE 2
+
+/* Read a whole descriptor: open it for reading, read it in chunks that fit
+   an FCP frame, and close it. descriptor_identifier is the complete
+   descriptor_specifier. At most size bytes are stored in buffer. Returns
+   the length of the descriptor including its length field, which may
+   exceed size, or -1 on failure. */
+int
+avc1394_descriptor_read(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit,
+	unsigned char *descriptor_identifier, int len_descriptor_identifier,
+	unsigned char *buffer, int size);
+
+/* the largest descriptor, its 16 bit length field included */
+#define AVC1394_DESCRIPTOR_MAX (0xFFFF + 2)
+
+/* An object list descriptor split into its entries. The pointers refer to
+   the descriptor it was parsed from. */
+typedef struct avc1394_object_entry_struct {
+	unsigned char	type;
+	unsigned char	attributes;
+	unsigned char	*data;		/* the rest of the entry */
+	int		length;		/* of data */
+} avc1394_object_entry;
+
+typedef struct avc1394_object_list_struct {
+	unsigned char	type;
+	unsigned char	attributes;
+	unsigned char	*info;		/* list_specific_information */
+	int		info_length;
+	int		count;
+	avc1394_object_entry *entries;
+} avc1394_object_list;
+
+/* Parse length bytes of an object list descriptor. Returns NULL if it is
+   malformed; release the result with free(). */
+avc1394_object_list *
+avc1394_object_list_parse(unsigned char *descriptor, int length);
+
+/*
+ * Descriptor cache for one device. Descriptors are read once and kept
+ * until a bus reset, or, if watch is set, until the device answers a
+ * NOTIFY armed for each of them with CHANGED. A descriptor whose NOTIFY
+ * the device refuses is kept until a bus reset. Armed notifications are
+ * outstanding non-blocking transactions on the handle.
+ */
+typedef struct avc1394_descriptor_cache_struct avc1394_descriptor_cache;
+
+avc1394_descriptor_cache *
+avc1394_descriptor_cache_new(raw1394handle_t handle, nodeid_t node, int watch);
+
+void
+avc1394_descriptor_cache_free(avc1394_descriptor_cache *cache);
+
+/* forget every descriptor */
+void
+avc1394_descriptor_cache_flush(avc1394_descriptor_cache *cache);
+
+/* The descriptor, read from the device if it is not cached. The data
+   belongs to the cache and stays valid until the descriptor is dropped by
+   a later call. Returns NULL on failure. */
+unsigned char *
+avc1394_descriptor_cache_get(avc1394_descriptor_cache *cache,
+	quadlet_t subunit,
+	unsigned char *descriptor_identifier, int len_descriptor_identifier,
+	int *length);
+
+/* As above, parsed as an object list */
+avc1394_object_list *
+avc1394_descriptor_cache_object_list(avc1394_descriptor_cache *cache,
+	quadlet_t subunit,
+	unsigned char *descriptor_identifier, int len_descriptor_identifier);
+
+/* The subunit's specifier field widths, from its cached subunit
+   identifier descriptor. Returns 0 or -1. */
+int
+avc1394_descriptor_cache_sizes(avc1394_descriptor_cache *cache,
+	quadlet_t subunit, avc1394_descriptor_sizes *sizes);
+
+/* Have the subunit search for the byte string search_for in the list or
+   entry given by the descriptor specifier search_in, from the specifier
+   start_point on, in direction (AVC1394_OPERAND_SEARCH_DIRECTION_...).
+   The specifier of the match, as long as start_point, is stored in result.
+   Returns its length, 0 if nothing matched, or -1 on failure. */
+int
+avc1394_search_descriptor(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char *search_for, int search_for_len,
+	unsigned char *search_in, int search_in_len,
+	unsigned char *start_point, int start_point_len,
+	unsigned char direction, unsigned char *result);
+
+/* Select the object given by the descriptor specifier object for output on
+   the subunit's source plug, with subfunction one of
+   AVC1394_OPERAND_OBJECT_NUMBER_SELECT_...; object_len 0 with CLEAR
+   deselects everything. Returns the AVC1394_RESP_... code or -1. */
+int
+avc1394_object_number_select(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char plug, unsigned char subfunction,
+	unsigned char *object, int object_len);
+
+/* Numbers of plugs of the unit or a subunit, from PLUG INFO */
+typedef struct avc1394_plugs_struct {
+	unsigned char	iso_inputs;		/* destination plugs of a subunit */
+	unsigned char	iso_outputs;	/* source plugs of a subunit */
+	unsigned char	external_inputs;
+	unsigned char	external_outputs;
+} avc1394_plugs;
+
+/* A connection between subunit and unit plugs. The subunit ends are a
+   subunit_type and id byte, or AVC1394_CONNECTION_UNIT for a unit plug. */
+typedef struct avc1394_connection_struct {
+	int				lock;
+	int				perm;
+	unsigned char	source_subunit;
+	unsigned char	source_plug;
+	unsigned char	destination_subunit;
+	unsigned char	destination_plug;
+} avc1394_connection;
+
+/* The operands of CONNECT AV and DISCONNECT AV: the four 2 bit end types
+   packed into types, then the ends in frame order */
+typedef struct avc1394_av_connection_struct {
+	unsigned char	types;
+	unsigned char	audio_source;
+	unsigned char	video_source;
+	unsigned char	audio_destination;
+	unsigned char	video_destination;
+} avc1394_av_connection;
+
+/* as many connections as fit one CONNECTIONS response */
+#define AVC1394_CONNECTIONS_MAX 100
+
+/* plugs of subunit, or of the unit with AVC1394_SUBUNIT_TYPE_UNIT |
+   AVC1394_SUBUNIT_ID_IGNORE; returns 0, or -1 */
+int
+avc1394_plug_info(raw1394handle_t handle, nodeid_t node, quadlet_t subunit,
+	avc1394_plugs *info);
+
+/* these return the AVC1394_RESP_... code or -1 */
+int
+avc1394_connect(raw1394handle_t handle, nodeid_t node,
+	const avc1394_connection *connection);
+
+int
+avc1394_disconnect(raw1394handle_t handle, nodeid_t node,
+	const avc1394_connection *connection);
+
+int
+avc1394_connect_av(raw1394handle_t handle, nodeid_t node,
+	const avc1394_av_connection *connection);
+
+int
+avc1394_disconnect_av(raw1394handle_t handle, nodeid_t node,
+	const avc1394_av_connection *connection);
+
+/* Fill in up to max of the unit's connections; returns how many, or -1 */
+int
+avc1394_connections(raw1394handle_t handle, nodeid_t node,
+	avc1394_connection *connections, int max);
+
+/* Who uses an isochronous channel: returns 1 with the node and its output
+   plug, 0 if nobody does, or -1 */
+int
+avc1394_channel_usage(raw1394handle_t handle, nodeid_t node, int channel,
+	nodeid_t *user, int *plug);
+
+/* Signal format of a serial bus input or output plug as fmt in the top
+   byte and fdf below; returns 0, or -1 */
+int
+avc1394_get_plug_signal_format(raw1394handle_t handle, nodeid_t node,
+	int output, int plug, quadlet_t *format);
+
+/* returns the AVC1394_RESP_... code or -1 */
+int
+avc1394_set_plug_signal_format(raw1394handle_t handle, nodeid_t node,
+	int output, int plug, quadlet_t format);
+
+/* DIGITAL INPUT or OUTPUT with state AVC1394_OPERAND_DIGITAL_ESTABLISH or
+   BREAK returns the AVC1394_RESP_... code; with STATUS it returns the
+   current ESTABLISH or BREAK state. -1 on failure. */
+int
+avc1394_digital_connection(raw1394handle_t handle, nodeid_t node,
+	int output, unsigned char state);
+
+/*
+ * A device's unit plugs and connections, read once and kept until a bus
+ * reset. With watch set, a NOTIFY CONNECTIONS is kept armed and CHANGED
+ * drops the graph too, save the one that a connection made through the
+ * graph causes: that one is taken, the NOTIFY armed again and the graph
+ * updated in place. A device that refuses the NOTIFY is not asked again.
+ */
+typedef struct avc1394_plug_graph_struct avc1394_plug_graph;
+
+avc1394_plug_graph *
+avc1394_plug_graph_new(raw1394handle_t handle, nodeid_t node, int watch);
+
+void
+avc1394_plug_graph_free(avc1394_plug_graph *graph);
+
+/* forget the graph, it is read again when next needed */
+void
+avc1394_plug_graph_flush(avc1394_plug_graph *graph);
+
+/* The unit's plugs and connections, read from the device if the graph is
+   not current. The connections belong to the graph. Returns their number,
+   or -1. */
+int
+avc1394_plug_graph_get(avc1394_plug_graph *graph, avc1394_plugs *plugs,
+	avc1394_connection **connections);
+
+/* avc1394_connect() and avc1394_disconnect(), keeping the graph current */
+int
+avc1394_plug_graph_connect(avc1394_plug_graph *graph,
+	const avc1394_connection *connection);
+
+int
+avc1394_plug_graph_disconnect(avc1394_plug_graph *graph,
+	const avc1394_connection *connection);
+
+/* POWER ON or OFF; returns the AVC1394_RESP_... code or -1 */
+int
+avc1394_power(raw1394handle_t handle, nodeid_t node, int on);
+
+/* returns 1 if the unit is on, 0 if off, -1 if it did not answer */
+int
+avc1394_power_status(raw1394handle_t handle, nodeid_t node);
+
+/* A unit to wake with avc1394_power_wake() */
+typedef struct avc1394_power_entry_struct {
+	raw1394handle_t	handle;
+	nodeid_t		node;
+	int				result;		/* response to POWER ON, or -1 */
+	long			ready;		/* ms until it reported power on, or -1 */
+} avc1394_power_entry;
+
+/* Send POWER ON to every unit at once, then poll each one's power status,
+   backing off from 20 ms to 1 s between polls, until it reports on. A unit
+   that holds its POWER ON with an INTERIM response is ready when it accepts.
+   Gives up after timeout ms. Returns the number of units not ready, or -1. */
+int
+avc1394_power_wake(avc1394_power_entry *entries, int count, int timeout);
+
+/* Signal formats known to avc1394_signal_formats_... */
+enum avc1394_signal_format {
+	AVC1394_SIGNAL_SD_525_60,
+	AVC1394_SIGNAL_SDL_525_60,
+	AVC1394_SIGNAL_HD_1125_60,
+	AVC1394_SIGNAL_SD_625_50,
+	AVC1394_SIGNAL_SDL_625_50,
+	AVC1394_SIGNAL_HD_1250_50,
+	AVC1394_SIGNAL_DVCPRO25_525_60,
+	AVC1394_SIGNAL_DVCPRO25_625_50,
+	AVC1394_SIGNAL_DVCPRO50_525_60,
+	AVC1394_SIGNAL_DVCPRO50_625_50,
+	AVC1394_SIGNAL_MPEG_25_60,	/* HDV and other MPEG-2 TS */
+	AVC1394_SIGNAL_MPEG_25_50,
+	AVC1394_SIGNAL_FORMATS
+};
+
+/* Where a signal format applies: the tape recorder's INPUT or OUTPUT
+   SIGNAL MODE, or the unit's serial bus plug signal format */
+enum avc1394_signal_target {
+	AVC1394_SIGNAL_VCR_INPUT,
+	AVC1394_SIGNAL_VCR_OUTPUT,
+	AVC1394_SIGNAL_PLUG_INPUT,
+	AVC1394_SIGNAL_PLUG_OUTPUT,
+	AVC1394_SIGNAL_TARGETS
+};
+
+/* A device's signal format capabilities, probed once */
+typedef struct avc1394_signal_formats_struct {
+	raw1394handle_t	handle;
+	nodeid_t		node;
+	int				plug;		/* the serial bus plug for the PLUG targets */
+	int				probed;
+	unsigned int	generation;
+	int				implemented[AVC1394_SIGNAL_TARGETS];
+	unsigned int	supported[AVC1394_SIGNAL_TARGETS];	/* 1 << format */
+} avc1394_signal_formats;
+
+void
+avc1394_signal_formats_init(avc1394_signal_formats *formats,
+	raw1394handle_t handle, nodeid_t node, int plug);
+
+/* Find the targets that answer a status query and SPECIFIC INQUIRY every
+   format on them, a few commands in flight at a time. The functions below do this
+   themselves when needed, and again after a bus reset. Returns 0, or -1
+   if the device answered for none of the targets. */
+int
+avc1394_signal_formats_probe(avc1394_signal_formats *formats);
+
+/* returns 1 if target can be set to format */
+int
+avc1394_signal_formats_supported(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target, enum avc1394_signal_format format);
+
+/* The first of count preferred formats that target is set to, asked of the
+   device each time, or else the first it supports; -1 if none */
+int
+avc1394_signal_formats_select(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target,
+	const enum avc1394_signal_format *preferred, int count);
+
+/* Set target to format with one CONTROL command. Nothing is sent if it is
+   known to be unsupported. Returns the AVC1394_RESP_... code or -1. */
+int
+avc1394_signal_formats_set(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target, enum avc1394_signal_format format);
+
+/*
+ * Tuner subunit. A service is selected with one DIRECT SELECT INFORMATION
+ * TYPE command, by its broadcast IDs or by channel number. tuner is the
+ * AVC1394_SUBUNIT_ID_... of the tuner, plug its output plug.
+ */
+#define AVC1394_TUNER_SERVICE_ID 0x01		/* network, stream and service IDs */
+#define AVC1394_TUNER_SERVICE_CHANNEL 0x02	/* major and minor channel number */
+
+typedef struct avc1394_tuner_service_struct {
+	int		type;		/* AVC1394_TUNER_SERVICE_... */
+	unsigned int	network_id;	/* original network, for _ID */
+	unsigned int	stream_id;	/* transport stream, for _ID */
+	unsigned int	service_id;	/* program number, for _ID */
+	unsigned int	major;		/* for _CHANNEL */
+	unsigned int	minor;		/* for _CHANNEL, 0 for analog */
+} avc1394_tuner_service;
+
+/* What TUNER STATUS reports for a tuner output plug */
+typedef struct avc1394_tuner_status_struct {
+	int		searching;
+	int		locked;		/* to a signal */
+	int		ca_enabled;	/* conditional access for the service */
+	int		signal;		/* strength, 0 to 255 */
+	avc1394_tuner_service service;	/* the one selected */
+} avc1394_tuner_status;
+
+/* these return the AVC1394_RESP_... code or -1 */
+int
+avc1394_tuner_direct_select(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, const avc1394_tuner_service *service);
+
+int
+avc1394_tuner_ca_enable(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, const avc1394_tuner_service *service, int enable);
+
+/* returns 0, or -1 */
+int
+avc1394_tuner_get_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, avc1394_tuner_status *status);
+
+/* A tuner whose status is kept until a bus reset, or, with watch set,
+   until the device answers the NOTIFY armed on it with CHANGED */
+typedef struct avc1394_tuner_struct avc1394_tuner;
+
+avc1394_tuner *
+avc1394_tuner_new(raw1394handle_t handle, nodeid_t node, quadlet_t tuner,
+	int plug, int watch);
+
+void
+avc1394_tuner_free(avc1394_tuner *tuner);
+
+/* forget the status, it is read again when next asked for */
+void
+avc1394_tuner_flush(avc1394_tuner *tuner);
+
+/* Select service with one CONTROL command, or none if it is known to be
+   selected already. Returns the AVC1394_RESP_... code or -1. */
+int
+avc1394_tuner_select(avc1394_tuner *tuner, const avc1394_tuner_service *service);
+
+/* the status, read from the device only when not known; returns 0 or -1 */
+int
+avc1394_tuner_read_status(avc1394_tuner *tuner, avc1394_tuner_status *status);
+
+/*
+ * Music subunit. Its status descriptor tells the stream formats of its
+ * plugs and how the signals in them map to music plugs.
+ */
+#define AVC1394_OPERAND_DESCRIPTOR_TYPE_MUSIC_STATUS_DESCRIPTOR 0x80
+
+/* A signal in a cluster: the music plug it belongs to and its place in
+   the stream */
+typedef struct avc1394_music_signal_struct {
+	unsigned int	music_plug_id;
+	unsigned char	stream_position;
+	unsigned char	stream_location;
+} avc1394_music_signal;
+
+/* Signals of one stream format within a subunit plug */
+typedef struct avc1394_music_cluster_struct {
+	unsigned char	stream_format;
+	unsigned char	port_type;
+	int		count;
+	avc1394_music_signal *signals;
+} avc1394_music_cluster;
+
+typedef struct avc1394_music_subunit_plug_struct {
+	int		source;		/* 1 for a source plug, 0 for a destination */
+	unsigned char	id;
+	unsigned int	signal_format;
+	unsigned char	type;
+	int		channels;
+	int		count;
+	avc1394_music_cluster *clusters;
+} avc1394_music_subunit_plug;
+
+/* One end of the route of a music plug */
+typedef struct avc1394_music_plug_end_struct {
+	unsigned char	function_type;
+	unsigned char	plug;
+	unsigned char	function_block;
+	unsigned char	stream_position;
+	unsigned char	stream_location;
+} avc1394_music_plug_end;
+
+typedef struct avc1394_music_plug_struct {
+	unsigned char	type;
+	unsigned int	id;
+	unsigned char	routing_support;
+	avc1394_music_plug_end source;
+	avc1394_music_plug_end destination;
+} avc1394_music_plug;
+
+/* What a music subunit and its unit report. The arrays are part of the
+   same allocation. */
+typedef struct avc1394_music_status_struct {
+	octlet_t	guid;
+	avc1394_plugs	unit_plugs;	/* PLUG INFO of the unit */
+	avc1394_plugs	plugs;		/* PLUG INFO of the music subunit */
+	unsigned char	transmit_capability;	/* AVC1394_SUBUNIT_MUSIC_CAPABILITY_... */
+	unsigned char	receive_capability;
+	int		plug_count;
+	avc1394_music_subunit_plug *subunit_plugs;
+	int		music_plug_count;
+	avc1394_music_plug *music_plugs;
+} avc1394_music_status;
+
+/* Parse length bytes of a music subunit status descriptor, leaving guid
+   and the plug counts zero. Returns NULL if it is malformed; release the
+   result with free(). */
+avc1394_music_status *
+avc1394_music_status_parse(unsigned char *descriptor, int length);
+
+/* Read the GUID, both PLUG INFOs and the status descriptor of the first
+   music subunit, with the PLUG INFOs answered while the descriptor is
+   read. Returns NULL on failure; release the result with free(). */
+avc1394_music_status *
+avc1394_music_status_read(raw1394handle_t handle, nodeid_t node);
+
+/*
+ * Music subunit status of several devices, kept by GUID until a bus reset,
+ * or, with watch set, until the device answers a NOTIFY armed on the status
+ * descriptor with CHANGED. It is re-read and the NOTIFY armed again on the
+ * next lookup; a device that refuses the NOTIFY is kept until a bus reset.
+ */
+typedef struct avc1394_music_cache_struct avc1394_music_cache;
+
+avc1394_music_cache *
+avc1394_music_cache_new(raw1394handle_t handle, int watch);
+
+void
+avc1394_music_cache_free(avc1394_music_cache *cache);
+
+/* forget every device */
+void
+avc1394_music_cache_flush(avc1394_music_cache *cache);
+
+/* The status of node, read from the device if it is not cached. It belongs
+   to the cache and stays valid until it is dropped by a later call.
+   Returns NULL on failure. */
+avc1394_music_status *
+avc1394_music_cache_get(avc1394_music_cache *cache, nodeid_t node);
+
+/* the cached status of the device with guid, or NULL; sends nothing */
+avc1394_music_status *
+avc1394_music_cache_find(avc1394_music_cache *cache, octlet_t guid);
+
 int
 avc1394_subunit_info(raw1394handle_t handle, nodeid_t node, quadlet_t *table);
 
@@ -505,6 +1199,57 @@ typedef int (*avc1394_command_handler_t)(struct avc1394_command_response*);
 int
 avc1394_init_target( raw1394handle_t handle, avc1394_command_handler_t );
 
+/* Frame callback prototype. request is the command as received; response
+   starts as a copy of it and may grow to AVC1394_FRAME_MAX. Return 1 to
+   send response, or 0 to answer NOT IMPLEMENTED. Commands longer than
+   struct avc1394_command_response only reach a frame handler. */
+typedef int (*avc1394_frame_handler_t)(nodeid_t node,
+	const avc1394_frame *request, avc1394_frame *response);
+
+int
+avc1394_init_target_frames(raw1394handle_t handle, avc1394_frame_handler_t handler);
+
+/*
+ * VENDOR-DEPENDENT commands: a 24-bit company ID, then up to
+ * AVC1394_VENDOR_PAYLOAD_MAX bytes the vendor defines.
+ */
+#define AVC1394_VENDOR_PAYLOAD_MAX (AVC1394_FRAME_MAX - 6)
+
+/* build a command with ctype for subunit (AVC1394_SUBUNIT_TYPE_... |
+   AVC1394_SUBUNIT_ID_...) in buffer of size bytes, and look at it through
+   frame. payload may be NULL to be written in place afterwards. Returns -1
+   if it does not fit. */
+int
+avc1394_vendor_build(avc1394_frame *frame, unsigned char *buffer,
+	unsigned int size, quadlet_t ctype, quadlet_t subunit,
+	unsigned int company_id, const unsigned char *payload, int len);
+
+/* the company ID of a VENDOR-DEPENDENT command or response, or -1 */
+long
+avc1394_vendor_company_id(const avc1394_frame *frame);
+
+/* the payload in place, its length in len; NULL if not VENDOR-DEPENDENT */
+unsigned char *
+avc1394_vendor_payload(const avc1394_frame *frame, int *len);
+
+/* send a command; complete it with the avc1394_transaction_... functions
+   and read the response through avc1394_transaction_frame() */
+avc1394_pending *
+avc1394_vendor_start(raw1394handle_t handle, nodeid_t node, quadlet_t ctype,
+	quadlet_t subunit, unsigned int company_id,
+	const unsigned char *payload, int len);
+
+/* Vendor command callback, see avc1394_frame_handler_t; data is what the
+   handler was registered with */
+typedef int (*avc1394_vendor_handler_t)(nodeid_t node,
+	const avc1394_frame *request, avc1394_frame *response, void *data);
+
+/* serve the commands of company_id with handler, ahead of the target's
+   own handler; NULL removes it. Returns -1 if out of memory. */
+int
+avc1394_vendor_register(unsigned int company_id,
+	avc1394_vendor_handler_t handler, void *data);
+
 int
 avc1394_close_target( raw1394handle_t handle );
 
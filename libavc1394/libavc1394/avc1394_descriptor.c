@@ -0,0 +1,579 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_descriptor.c - read AV/C descriptors of any length: open, read
+ * in chunks that fit an FCP frame, close. Keep them in a per-device cache
+ * that is dropped on bus reset or when the device notifies a change.
+ * Search lists and select objects on the device itself.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+/* read_result_status of a READ DESCRIPTOR response */
+#define READ_COMPLETE 0x10
+#define READ_MORE 0x11
+#define READ_TOO_LARGE 0x12
+
+/* the operands after the descriptor_specifier: read_result_status,
+   reserved, data_length and address */
+#define READ_OPERANDS 6
+
+static avc1394_pending *start_read(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char *specifier, int specifier_len,
+	int address, int length)
+{
+	unsigned char operands[specifier_len + READ_OPERANDS];
+	quadlet_t request[(specifier_len + READ_OPERANDS + 6) / 4];
+	int len;
+
+	memcpy(operands, specifier, specifier_len);
+	operands[specifier_len] = 0xFF;
+	operands[specifier_len + 1] = 0x00;
+	operands[specifier_len + 2] = length >> 8;
+	operands[specifier_len + 3] = length & 0xFF;
+	operands[specifier_len + 4] = address >> 8;
+	operands[specifier_len + 5] = address & 0xFF;
+	len = pack_request(request,
+		AVC1394_CTYPE_CONTROL | subunit | AVC1394_COMMAND_READ_DESCRIPTOR,
+		operands, specifier_len + READ_OPERANDS);
+	htonl_block(request, len);
+	return pending_start_match(handle, node, request, len, specifier_len);
+}
+
+/* store the data of a READ DESCRIPTOR response read from address;
+   returns its length or -1 */
+static int finish_read(avc1394_pending *p, int specifier_len,
+	unsigned char *buffer, int size, int address, int *status)
+{
+	unsigned char header[READ_OPERANDS];
+	quadlet_t *response;
+	unsigned int len;
+	int count;
+
+	if (avc1394_transaction_wait(p) != AVC1394_RESP_ACCEPTED)
+		return -1;
+	response = avc1394_transaction_response(p, &len);
+	if (unpack_response(response, len, specifier_len, header, READ_OPERANDS)
+			< READ_OPERANDS)
+		return -1;
+	/* a response for some other read in flight */
+	if (((header[4] << 8) | header[5]) != address)
+		return -1;
+	*status = header[0];
+	count = (header[2] << 8) | header[3];
+	if (address + count > size)
+		count = size - address;
+	return unpack_response(response, len, specifier_len + READ_OPERANDS,
+		buffer + address, count);
+}
+
+/* OPEN DESCRIPTOR in network byte order, with the status form of the
+   operands unless ctype is CONTROL. request must hold (specifier_len + 10)
+   / 4 quadlets; returns its length. */
+static int access_request(quadlet_t *request, quadlet_t ctype,
+	quadlet_t subunit, unsigned char *specifier, int specifier_len,
+	unsigned char subfunction)
+{
+	unsigned char operands[specifier_len + 4];
+	int len = specifier_len;
+
+	memcpy(operands, specifier, len);
+	if (ctype == AVC1394_CTYPE_CONTROL) {
+		operands[len++] = subfunction;
+		operands[len++] = 0x00;
+	} else {
+		/* status, reserved, node_ID */
+		operands[len++] = 0xFF;
+		operands[len++] = 0x00;
+		operands[len++] = 0xFF;
+		operands[len++] = 0xFF;
+	}
+	len = pack_request(request, ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR,
+		operands, len);
+	htonl_block(request, len);
+	return len;
+}
+
+/* open or close for this controller; returns 0 when accepted, or -1 */
+static int access_descriptor(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char *specifier, int specifier_len,
+	unsigned char subfunction)
+{
+	quadlet_t request[(specifier_len + 10) / 4];
+	avc1394_pending *p;
+	int len, result;
+
+	len = access_request(request, AVC1394_CTYPE_CONTROL, subunit,
+		specifier, specifier_len, subfunction);
+	/* several descriptors of one subunit may be opened at once */
+	p = pending_start_match(handle, node, request, len, specifier_len);
+	if (p == NULL)
+		return -1;
+	result = avc1394_transaction_wait(p);
+	avc1394_transaction_finish(p);
+	return result == AVC1394_RESP_ACCEPTED ? 0 : -1;
+}
+
+/* Watch a descriptor with a NOTIFY that is answered CHANGED when it
+   changes. Arm it after our own open and close, which would trigger it. */
+void descriptor_watch(struct watched *watched, nodeid_t node, quadlet_t subunit,
+	unsigned char *specifier, int specifier_len)
+{
+	quadlet_t request[(specifier_len + 10) / 4];
+	int len;
+
+	len = access_request(request, AVC1394_CTYPE_NOTIFY, subunit,
+		specifier, specifier_len, 0);
+	/* several descriptors of one subunit may be watched at once */
+	watch_arm(watched, node, request, len, specifier_len);
+}
+
+/* wait out and release the reads still in flight */
+static void drain(avc1394_pending **window, int outstanding)
+{
+	int i;
+
+	for (i = 0; i < outstanding; i++) {
+		avc1394_transaction_wait(window[i]);
+		avc1394_transaction_finish(window[i]);
+	}
+}
+
+int avc1394_descriptor_read(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char *specifier, int specifier_len,
+	unsigned char *buffer, int size)
+{
+	avc1394_pending *window[AVC1394_DESCRIPTOR_PIPELINE];
+	int address[AVC1394_DESCRIPTOR_PIPELINE], want[AVC1394_DESCRIPTOR_PIPELINE];
+	int chunk = MAX_RESPONSE_SIZE - 3 - specifier_len - READ_OPERANDS;
+	int depth = 1, outstanding = 0, issued = 0, got = 0, total = -1;
+	int limit, status, done = 0, result = 0;
+	int i, n, at, asked;
+
+	if (access_descriptor(handle, node, subunit, specifier, specifier_len,
+			AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_READ_OPEN) < 0)
+		return -1;
+
+	while (!done) {
+		limit = (total >= 0 && total < size) ? total : size;
+
+		/* the first read tells the length, then several are kept in
+		   flight so the device never waits for us */
+		while (outstanding < depth && issued < limit) {
+			n = limit - issued < chunk ? limit - issued : chunk;
+			window[outstanding] = start_read(handle, node, subunit,
+				specifier, specifier_len, issued, n);
+			if (window[outstanding] == NULL)
+				break;
+			address[outstanding] = issued;
+			want[outstanding++] = n;
+			issued += n;
+		}
+		if (outstanding == 0) {
+			result = got < limit ? -1 : 0;
+			break;
+		}
+
+		at = address[0];
+		asked = want[0];
+		n = finish_read(window[0], specifier_len, buffer, size, at, &status);
+		avc1394_transaction_finish(window[0]);
+		for (i = 1; i < outstanding; i++) {
+			window[i - 1] = window[i];
+			address[i - 1] = address[i];
+			want[i - 1] = want[i];
+		}
+		outstanding--;
+
+		if (n < 0) {
+			drain(window, outstanding);
+			outstanding = 0;
+			if (depth == 1) {
+				result = -1;
+				break;
+			}
+			/* rejected while busy: carry on one read at a time */
+			issued = got;
+			depth = 1;
+			continue;
+		}
+		got = at + n;
+		if (total < 0 && got >= 2) {
+			total = 2 + ((buffer[0] << 8) | buffer[1]);
+			depth = AVC1394_DESCRIPTOR_PIPELINE;
+		}
+		limit = (total >= 0 && total < size) ? total : size;
+		if (n == 0 || status == READ_TOO_LARGE || got >= limit) {
+			done = 1;
+		} else if (n < asked) {
+			/* a short read puts the reads in flight at the wrong
+			   addresses */
+			drain(window, outstanding);
+			outstanding = 0;
+			issued = got;
+		}
+	}
+	drain(window, outstanding);
+
+#ifdef DEBUG
+	fprintf(stderr, "avc1394_descriptor_read: %d of %d bytes\n", got, total);
+#endif
+
+	access_descriptor(handle, node, subunit, specifier, specifier_len,
+		AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_CLOSE);
+	if (result < 0)
+		return -1;
+	return total >= 0 ? total : got;
+}
+
+int avc1394_descriptor_sizes_parse(unsigned char *identifier, int length,
+	avc1394_descriptor_sizes *sizes)
+{
+	/* descriptor_length, generation_ID, then the three sizes */
+	if (length < 6)
+		return -1;
+	sizes->list_id = identifier[3];
+	sizes->object_id = identifier[4];
+	sizes->object_position = identifier[5];
+	return 0;
+}
+
+/* append the low size bytes of value, most significant first */
+static int put_field(unsigned char *p, unsigned long long value, int size)
+{
+	int i;
+
+	if (size < 0 || size > 8)
+		return -1;
+	for (i = size - 1; i >= 0; i--, value >>= 8)
+		p[i] = value & 0xFF;
+	return size;
+}
+
+int avc1394_descriptor_specifier(unsigned char *specifier,
+	const avc1394_descriptor_sizes *sizes, unsigned char type,
+	unsigned long long id, unsigned long long position)
+{
+	int n, len = 1;
+
+	specifier[0] = type;
+	switch (type) {
+	case AVC1394_OPERAND_DESCRIPTOR_TYPE_SUBUNIT_IDENTIFIER_DESCRIPTOR:
+		return len;
+	case AVC1394_OPERAND_DESCRIPTOR_TYPE_OBJECT_LIST_DESCRIPTOR_ID:
+		n = put_field(specifier + len, id, sizes->list_id);
+		break;
+	case AVC1394_OPERAND_DESCRIPTOR_TYPE_OBJECT_LIST_DESCRIPTOR_TYPE:
+		specifier[len] = id;
+		n = 1;
+		break;
+	case AVC1394_OPERAND_DESCRIPTOR_TYPE_OBJECT_ENTRY_DESCRIPTOR_POSITION:
+		if ((n = put_field(specifier + len, id, sizes->list_id)) < 0)
+			return -1;
+		len += n;
+		n = put_field(specifier + len, position, sizes->object_position);
+		break;
+	case AVC1394_OPERAND_DESCRIPTOR_TYPE_OBJECT_ENTRY_DESCRIPTOR_ID:
+		n = put_field(specifier + len, id, sizes->object_id);
+		break;
+	default:
+		return -1;
+	}
+	return n < 0 ? -1 : len + n;
+}
+
+avc1394_object_list *avc1394_object_list_parse(unsigned char *descriptor, int length)
+{
+	avc1394_object_list *list;
+	int i, count, offset, info, size;
+
+	/* descriptor_length, list_type, attributes,
+	   size_of_list_specific_information */
+	if (length < 6)
+		return NULL;
+	info = (descriptor[4] << 8) | descriptor[5];
+	if (6 + info + 2 > length)
+		return NULL;
+	count = (descriptor[6 + info] << 8) | descriptor[7 + info];
+
+	list = malloc(sizeof(avc1394_object_list) + count * sizeof(avc1394_object_entry));
+	if (list == NULL)
+		return NULL;
+	list->type = descriptor[2];
+	list->attributes = descriptor[3];
+	list->info = descriptor + 6;
+	list->info_length = info;
+	list->count = count;
+	list->entries = (avc1394_object_entry *) (list + 1);
+
+	/* each entry: descriptor_length, entry_type, attributes, the rest */
+	for (i = 0, offset = 8 + info; i < count; i++, offset += 2 + size) {
+		if (offset + 4 > length)
+			break;
+		size = (descriptor[offset] << 8) | descriptor[offset + 1];
+		if (size < 2 || offset + 2 + size > length)
+			break;
+		list->entries[i].type = descriptor[offset + 2];
+		list->entries[i].attributes = descriptor[offset + 3];
+		list->entries[i].data = descriptor + offset + 4;
+		list->entries[i].length = size - 2;
+	}
+	if (i < count) {
+		free(list);
+		return NULL;
+	}
+	return list;
+}
+
+
+struct descriptor_entry {
+	quadlet_t subunit;
+	unsigned char *specifier;
+	int specifier_len;
+	unsigned char *data;
+	int length;
+	avc1394_object_list *list;	/* parsed on demand */
+	struct watched watched;
+	struct descriptor_entry *next;
+};
+
+struct avc1394_descriptor_cache_struct {
+	raw1394handle_t handle;
+	nodeid_t node;
+	int watch;
+	struct descriptor_entry *entries;
+};
+
+static void drop_entry(struct descriptor_entry *e)
+{
+	watch_stop(&e->watched);
+	free(e->list);
+	free(e->data);
+	free(e);
+}
+
+avc1394_descriptor_cache *avc1394_descriptor_cache_new(raw1394handle_t handle,
+	nodeid_t node, int watch)
+{
+	avc1394_descriptor_cache *cache = calloc(1, sizeof(avc1394_descriptor_cache));
+
+	if (cache == NULL)
+		return NULL;
+	cache->handle = handle;
+	cache->node = node;
+	cache->watch = watch;
+	return cache;
+}
+
+void avc1394_descriptor_cache_flush(avc1394_descriptor_cache *cache)
+{
+	struct descriptor_entry *e;
+
+	while ((e = cache->entries) != NULL) {
+		cache->entries = e->next;
+		drop_entry(e);
+	}
+}
+
+void avc1394_descriptor_cache_free(avc1394_descriptor_cache *cache)
+{
+	avc1394_descriptor_cache_flush(cache);
+	free(cache);
+}
+
+/* the valid entry for a descriptor, read into the cache when needed */
+static struct descriptor_entry *cache_entry(avc1394_descriptor_cache *cache,
+	quadlet_t subunit, unsigned char *specifier, int specifier_len)
+{
+	struct descriptor_entry *e, **link;
+	unsigned char *buffer;
+	int length;
+
+	for (link = &cache->entries; (e = *link) != NULL; link = &e->next) {
+		if (e->subunit != subunit || e->specifier_len != specifier_len
+				|| memcmp(e->specifier, specifier, specifier_len) != 0)
+			continue;
+		if (watch_check(&e->watched))
+			return e;
+		*link = e->next;
+		drop_entry(e);
+		break;
+	}
+
+	buffer = malloc(AVC1394_DESCRIPTOR_MAX);
+	e = calloc(1, sizeof(struct descriptor_entry) + specifier_len);
+	if (buffer == NULL || e == NULL) {
+		free(buffer);
+		free(e);
+		return NULL;
+	}
+	watch_start(&e->watched, cache->handle);
+	length = avc1394_descriptor_read(cache->handle, cache->node, subunit,
+		specifier, specifier_len, buffer, AVC1394_DESCRIPTOR_MAX);
+	if (length < 0) {
+		free(buffer);
+		free(e);
+		return NULL;
+	}
+	e->data = realloc(buffer, length > 0 ? length : 1);
+	if (e->data == NULL)
+		e->data = buffer;
+	e->length = length;
+	e->subunit = subunit;
+	e->specifier = (unsigned char *) (e + 1);
+	e->specifier_len = specifier_len;
+	memcpy(e->specifier, specifier, specifier_len);
+	e->watched.valid = 1;
+	if (cache->watch)
+		descriptor_watch(&e->watched, cache->node, subunit,
+			specifier, specifier_len);
+
+	e->next = cache->entries;
+	cache->entries = e;
+	return e;
+}
+
+unsigned char *avc1394_descriptor_cache_get(avc1394_descriptor_cache *cache,
+	quadlet_t subunit, unsigned char *descriptor_identifier,
+	int len_descriptor_identifier, int *length)
+{
+	struct descriptor_entry *e = cache_entry(cache, subunit,
+		descriptor_identifier, len_descriptor_identifier);
+
+	if (e == NULL)
+		return NULL;
+	if (length != NULL)
+		*length = e->length;
+	return e->data;
+}
+
+avc1394_object_list *avc1394_descriptor_cache_object_list(
+	avc1394_descriptor_cache *cache, quadlet_t subunit,
+	unsigned char *descriptor_identifier, int len_descriptor_identifier)
+{
+	struct descriptor_entry *e = cache_entry(cache, subunit,
+		descriptor_identifier, len_descriptor_identifier);
+
+	if (e == NULL)
+		return NULL;
+	if (e->list == NULL)
+		e->list = avc1394_object_list_parse(e->data, e->length);
+	return e->list;
+}
+
+int avc1394_descriptor_cache_sizes(avc1394_descriptor_cache *cache,
+	quadlet_t subunit, avc1394_descriptor_sizes *sizes)
+{
+	unsigned char specifier = AVC1394_OPERAND_DESCRIPTOR_TYPE_SUBUNIT_IDENTIFIER_DESCRIPTOR;
+	unsigned char *identifier;
+	int length;
+
+	identifier = avc1394_descriptor_cache_get(cache, subunit, &specifier, 1, &length);
+	if (identifier == NULL)
+		return -1;
+	return avc1394_descriptor_sizes_parse(identifier, length, sizes);
+}
+
+int avc1394_search_descriptor(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char *search_for, int search_for_len,
+	unsigned char *search_in, int search_in_len,
+	unsigned char *start_point, int start_point_len,
+	unsigned char direction, unsigned char *result)
+{
+	unsigned char operands[MAX_RESPONSE_SIZE];
+	avc1394_pending *p;
+	quadlet_t *response;
+	unsigned int response_len;
+	int len = 0, found;
+
+	if (2 + search_for_len + search_in_len + start_point_len + 2 > MAX_RESPONSE_SIZE - 3)
+		return -1;
+
+	/* search_for with its length, search_in, start_point, direction,
+	   response_format */
+	operands[len++] = search_for_len >> 8;
+	operands[len++] = search_for_len & 0xFF;
+	memcpy(operands + len, search_for, search_for_len);
+	len += search_for_len;
+	memcpy(operands + len, search_in, search_in_len);
+	len += search_in_len;
+	memcpy(operands + len, start_point, start_point_len);
+	len += start_point_len;
+	operands[len++] = direction;
+	operands[len++] = AVC1394_OPERAND_SEARCH_RESPONSE_SPECIFIER;
+
+	p = pending_command(handle, node,
+		AVC1394_CTYPE_CONTROL | subunit | AVC1394_COMMAND_SEARCH_DESCRIPTOR,
+		operands, len);
+	if (p == NULL)
+		return -1;
+	response = avc1394_transaction_response(p, &response_len);
+	switch (AVC1394_GET_RESPONSE(response[0])) {
+	case AVC1394_RESP_ACCEPTED:
+		/* the match replaces start_point */
+		found = unpack_response(response, response_len,
+			2 + search_for_len + search_in_len, result, start_point_len);
+		if (found < start_point_len)
+			found = -1;
+		break;
+	case AVC1394_RESP_REJECTED:
+		found = 0;
+		break;
+	default:
+		found = -1;
+	}
+	avc1394_transaction_finish(p);
+	return found;
+}
+
+int avc1394_object_number_select(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit, unsigned char plug, unsigned char subfunction,
+	unsigned char *object, int object_len)
+{
+	unsigned char operands[MAX_RESPONSE_SIZE];
+	avc1394_pending *p;
+	int len = 0, result;
+
+	if (4 + object_len > MAX_RESPONSE_SIZE - 3)
+		return -1;
+
+	/* source_plug, subfunction, status, number_of_ons_selection_specifications,
+	   then the one specification */
+	operands[len++] = plug;
+	operands[len++] = subfunction;
+	operands[len++] = 0xFF;
+	operands[len++] = object_len > 0 ? 1 : 0;
+	memcpy(operands + len, object, object_len);
+	len += object_len;
+
+	p = pending_command(handle, node,
+		AVC1394_CTYPE_CONTROL | subunit | AVC1394_COMMAND_OBJECT_NUMBER_SELECT,
+		operands, len);
+	if (p == NULL)
+		return -1;
+	result = AVC1394_GET_RESPONSE(avc1394_transaction_response(p, NULL)[0]);
+	avc1394_transaction_finish(p);
+	return result;
+}
@@ -0,0 +1,305 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_format.c - find out once which signal formats a device can
+ * record, play and exchange on its plugs, then answer format questions
+ * from that matrix and set a format with a single command.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <string.h>
+
+#define VCR (AVC1394_SUBUNIT_TYPE_VCR | AVC1394_SUBUNIT_ID_0)
+#define UNIT (AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE)
+
+/* probes kept in flight, devices handle few commands at a time */
+#define FORMAT_PIPELINE 2
+
+/* isochronous stream formats of the plug signal format commands */
+#define FMT_DV 0x80
+#define FMT_MPEG2_TS 0xA0
+
+/* the tape recorder signal_mode of each format; for DV it is also the FDF
+   of the plug signal format */
+static const unsigned char signal_mode[AVC1394_SIGNAL_FORMATS] = {
+	[AVC1394_SIGNAL_SD_525_60] = 0x00,
+	[AVC1394_SIGNAL_SDL_525_60] = 0x04,
+	[AVC1394_SIGNAL_HD_1125_60] = 0x08,
+	[AVC1394_SIGNAL_SD_625_50] = 0x80,
+	[AVC1394_SIGNAL_SDL_625_50] = 0x84,
+	[AVC1394_SIGNAL_HD_1250_50] = 0x88,
+	[AVC1394_SIGNAL_DVCPRO25_525_60] = 0x78,
+	[AVC1394_SIGNAL_DVCPRO25_625_50] = 0xF8,
+	[AVC1394_SIGNAL_DVCPRO50_525_60] = 0x74,
+	[AVC1394_SIGNAL_DVCPRO50_625_50] = 0xF4,
+	[AVC1394_SIGNAL_MPEG_25_60] = 0x10,
+	[AVC1394_SIGNAL_MPEG_25_50] = 0x90,
+};
+
+static int is_mpeg(enum avc1394_signal_format format)
+{
+	return format == AVC1394_SIGNAL_MPEG_25_60 || format == AVC1394_SIGNAL_MPEG_25_50;
+}
+
+static int is_plug(enum avc1394_signal_target target)
+{
+	return target == AVC1394_SIGNAL_PLUG_INPUT || target == AVC1394_SIGNAL_PLUG_OUTPUT;
+}
+
+/* fmt and the first FDF byte; the rest of the FDF is left to the device */
+static quadlet_t plug_format(enum avc1394_signal_format format)
+{
+	if (is_mpeg(format))
+		return FMT_MPEG2_TS << 24;
+	return (FMT_DV << 24) | (signal_mode[format] << 16) | 0xFFFF;
+}
+
+static quadlet_t target_header(enum avc1394_signal_target target)
+{
+	switch (target) {
+	case AVC1394_SIGNAL_VCR_INPUT:
+		return VCR | AVC1394_VCR_COMMAND_INPUT_SIGNAL_MODE;
+	case AVC1394_SIGNAL_VCR_OUTPUT:
+		return VCR | AVC1394_VCR_COMMAND_OUTPUT_SIGNAL_MODE;
+	case AVC1394_SIGNAL_PLUG_INPUT:
+		return UNIT | AVC1394_COMMAND_INPUT_PLUG_SIGNAL_FORMAT;
+	default:
+		return UNIT | AVC1394_COMMAND_OUTPUT_PLUG_SIGNAL_FORMAT;
+	}
+}
+
+/* the request to set target to format with ctype, or to read it back with
+   format < 0; returns its length in quadlets */
+static int format_request(quadlet_t *request, quadlet_t ctype,
+	enum avc1394_signal_target target, int plug, int format)
+{
+	unsigned char operands[5];
+	quadlet_t f;
+
+	if (!is_plug(target)) {
+		operands[0] = format < 0 ? 0xFF : signal_mode[format];
+		return pack_request(request, ctype | target_header(target), operands, 1);
+	}
+	f = format < 0 ? 0xFFFFFFFF : plug_format(format);
+	operands[0] = plug;
+	operands[1] = f >> 24;
+	operands[2] = f >> 16;
+	operands[3] = f >> 8;
+	operands[4] = f;
+	return pack_request(request, ctype | target_header(target), operands, 5);
+}
+
+/* the format a status response reports, or -1 */
+static int response_format(enum avc1394_signal_target target,
+	const quadlet_t *response, unsigned int len)
+{
+	unsigned char operands[3];
+	int i;
+
+	if (!is_plug(target)) {
+		if (unpack_response(response, len, 0, operands, 1) < 1)
+			return -1;
+		for (i = 0; i < AVC1394_SIGNAL_FORMATS; i++)
+			if (signal_mode[i] == operands[0])
+				return i;
+		return -1;
+	}
+	if (unpack_response(response, len, 1, operands, 2) < 2)
+		return -1;
+	for (i = 0; i < AVC1394_SIGNAL_FORMATS; i++)
+		if (plug_format(i) >> 16 == (quadlet_t) ((operands[0] << 8)
+				| (is_mpeg(i) ? 0 : operands[1])))
+			return i;
+	return -1;
+}
+
+struct probe {
+	enum avc1394_signal_target target;
+	int format;		/* -1 for the status of target */
+	quadlet_t request[2];
+	int len;
+};
+
+/* send the probes FORMAT_PIPELINE at a time and fold their responses into
+   the matrix */
+static void run_probes(avc1394_signal_formats *formats, struct probe *probes,
+	int count)
+{
+	avc1394_pending *window[FORMAT_PIPELINE];
+	int sent = 0, done = 0;
+
+	while (done < count) {
+		while (sent < count && sent - done < FORMAT_PIPELINE) {
+			window[sent % FORMAT_PIPELINE] = avc1394_transaction_start(
+				formats->handle, formats->node,
+				probes[sent].request, probes[sent].len);
+			sent++;
+		}
+		{
+			struct probe *pr = &probes[done];
+			avc1394_pending *p = window[done % FORMAT_PIPELINE];
+			int code = p != NULL ? avc1394_transaction_wait(p) : -1;
+
+			if (pr->format < 0) {
+				formats->implemented[pr->target] = code == AVC1394_RESP_STABLE;
+			} else if (code == AVC1394_RESP_IMPLEMENTED) {
+				formats->supported[pr->target] |= 1 << pr->format;
+			}
+			if (p != NULL)
+				avc1394_transaction_finish(p);
+			done++;
+		}
+	}
+}
+
+void avc1394_signal_formats_init(avc1394_signal_formats *formats,
+	raw1394handle_t handle, nodeid_t node, int plug)
+{
+	memset(formats, 0, sizeof(avc1394_signal_formats));
+	formats->handle = handle;
+	formats->node = node;
+	formats->plug = plug;
+}
+
+int avc1394_signal_formats_probe(avc1394_signal_formats *formats)
+{
+	struct probe probes[AVC1394_SIGNAL_TARGETS * AVC1394_SIGNAL_FORMATS];
+	int t, f, n = 0;
+
+	formats->generation = raw1394_get_generation(formats->handle);
+	for (t = 0; t < AVC1394_SIGNAL_TARGETS; t++) {
+		formats->supported[t] = 0;
+		probes[n].target = t;
+		probes[n].format = -1;
+		probes[n].len = format_request(probes[n].request,
+			AVC1394_CTYPE_STATUS, t, formats->plug, -1);
+		n++;
+	}
+	run_probes(formats, probes, n);
+
+	/* only ask about formats where the command itself is implemented */
+	n = 0;
+	for (t = 0; t < AVC1394_SIGNAL_TARGETS; t++) {
+		if (!formats->implemented[t])
+			continue;
+		for (f = 0; f < AVC1394_SIGNAL_FORMATS; f++) {
+			/* one plug format serves both MPEG rates */
+			if (is_plug(t) && f == AVC1394_SIGNAL_MPEG_25_50)
+				continue;
+			probes[n].target = t;
+			probes[n].format = f;
+			probes[n].len = format_request(probes[n].request,
+				AVC1394_CTYPE_SPECIFIC_INQUIRY, t, formats->plug, f);
+			n++;
+		}
+	}
+	run_probes(formats, probes, n);
+	for (t = 0; t < AVC1394_SIGNAL_TARGETS; t++)
+		if (is_plug(t) && formats->supported[t] & (1 << AVC1394_SIGNAL_MPEG_25_60))
+			formats->supported[t] |= 1 << AVC1394_SIGNAL_MPEG_25_50;
+
+	formats->probed = 1;
+	for (t = 0; t < AVC1394_SIGNAL_TARGETS; t++)
+		if (formats->implemented[t])
+			return 0;
+	return -1;
+}
+
+/* probe if never done or the node may have changed */
+static int formats_current(avc1394_signal_formats *formats)
+{
+	if (formats->probed
+			&& raw1394_get_generation(formats->handle) == formats->generation)
+		return 0;
+	return avc1394_signal_formats_probe(formats);
+}
+
+int avc1394_signal_formats_supported(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target, enum avc1394_signal_format format)
+{
+	if (formats_current(formats) < 0)
+		return 0;
+	return (formats->supported[target] >> format) & 1;
+}
+
+/* The format target is set to now, read from the device since it can
+   change under us: a deck's output follows the tape, and other controllers
+   set formats too. Returns -1 if unknown. */
+static int current_format(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target)
+{
+	avc1394_pending *p;
+	quadlet_t request[2];
+	quadlet_t *response;
+	unsigned int len;
+	int format = -1;
+
+	if (!formats->implemented[target])
+		return -1;
+	len = format_request(request, AVC1394_CTYPE_STATUS, target,
+		formats->plug, -1);
+	p = avc1394_transaction_start(formats->handle, formats->node, request, len);
+	if (p == NULL)
+		return -1;
+	if (avc1394_transaction_wait(p) == AVC1394_RESP_STABLE) {
+		response = avc1394_transaction_response(p, &len);
+		format = response_format(target, response, len);
+	}
+	avc1394_transaction_finish(p);
+	return format;
+}
+
+int avc1394_signal_formats_select(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target,
+	const enum avc1394_signal_format *preferred, int count)
+{
+	int i, current;
+
+	if (formats_current(formats) < 0)
+		return -1;
+	/* what is already set needs no change */
+	current = current_format(formats, target);
+	for (i = 0; i < count; i++)
+		if ((int) preferred[i] == current)
+			return preferred[i];
+	for (i = 0; i < count; i++)
+		if ((formats->supported[target] >> preferred[i]) & 1)
+			return preferred[i];
+	return -1;
+}
+
+int avc1394_signal_formats_set(avc1394_signal_formats *formats,
+	enum avc1394_signal_target target, enum avc1394_signal_format format)
+{
+	avc1394_pending *p;
+	quadlet_t request[2];
+	int len, result;
+
+	if (formats_current(formats) == 0
+			&& !((formats->supported[target] >> format) & 1))
+		return AVC1394_RESP_NOT_IMPLEMENTED;
+	len = format_request(request, AVC1394_CTYPE_CONTROL, target,
+		formats->plug, format);
+	p = avc1394_transaction_start(formats->handle, formats->node, request, len);
+	if (p == NULL)
+		return -1;
+	result = avc1394_transaction_wait(p);
+	avc1394_transaction_finish(p);
+	return result;
+}
@@ -0,0 +1,109 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_frame.c - read and write AV/C frames of any length in place,
+ * with every access checked against the frame.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+
+#include <string.h>
+
+/* ctype, subunit and opcode come before the operands */
+#define FRAME_HEADER 3
+
+int avc1394_frame_init(avc1394_frame *frame, unsigned char *data,
+	unsigned int length, unsigned int size)
+{
+	if (size > AVC1394_FRAME_MAX)
+		size = AVC1394_FRAME_MAX;
+	if (length < FRAME_HEADER || length > size)
+		return -1;
+	frame->data = data;
+	frame->length = length;
+	frame->size = size;
+	return 0;
+}
+
+int avc1394_frame_ctype(const avc1394_frame *frame)
+{
+	return frame->data[0] & 0x0F;
+}
+
+int avc1394_frame_subunit_type(const avc1394_frame *frame)
+{
+	return frame->data[1] >> 3;
+}
+
+int avc1394_frame_subunit_id(const avc1394_frame *frame)
+{
+	return frame->data[1] & 0x07;
+}
+
+int avc1394_frame_opcode(const avc1394_frame *frame)
+{
+	return frame->data[2];
+}
+
+int avc1394_frame_operand_count(const avc1394_frame *frame)
+{
+	return frame->length - FRAME_HEADER;
+}
+
+int avc1394_frame_operand(const avc1394_frame *frame, int n)
+{
+	if (n < 0 || n >= avc1394_frame_operand_count(frame))
+		return -1;
+	return frame->data[FRAME_HEADER + n];
+}
+
+unsigned char *avc1394_frame_operands(const avc1394_frame *frame, int offset,
+	int len)
+{
+	if (offset < 0 || len < 0 || offset + len > avc1394_frame_operand_count(frame))
+		return NULL;
+	return frame->data + FRAME_HEADER + offset;
+}
+
+int avc1394_frame_set_ctype(avc1394_frame *frame, int ctype)
+{
+	frame->data[0] = (frame->data[0] & 0xF0) | (ctype & 0x0F);
+	return 0;
+}
+
+int avc1394_frame_set_operand_count(avc1394_frame *frame, int count)
+{
+	unsigned int length = FRAME_HEADER + count;
+
+	if (count < 0 || length > frame->size)
+		return -1;
+	if (length > frame->length)
+		memset(frame->data + frame->length, 0, length - frame->length);
+	frame->length = length;
+	return 0;
+}
+
+int avc1394_frame_set_operand(avc1394_frame *frame, int n, unsigned char value)
+{
+	if (n < 0)
+		return -1;
+	if (n >= avc1394_frame_operand_count(frame)
+			&& avc1394_frame_set_operand_count(frame, n + 1) < 0)
+		return -1;
+	frame->data[FRAME_HEADER + n] = value;
+	return 0;
+}
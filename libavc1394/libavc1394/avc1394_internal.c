@@ -22,7 +22,9 @@
 #include "avc1394_internal.h"
 #include "../common/raw1394util.h"
 #include <netinet/in.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 
 void htonl_block(quadlet_t *buf, int len)
@@ -41,42 +43,170 @@ void ntohl_block(quadlet_t *buf, int len)
 	}
 }
 
+/*
+ * Build a request from ctype, subunit and opcode in header followed by
+ * len operand bytes. request must hold (len + 6) / 4 quadlets.
+ * RETURNS:	the request length in quadlets.
+ */
+int pack_request(quadlet_t *request, quadlet_t header,
+                 const unsigned char *operands, int len)
+{
+	int i, n = (len + 6) / 4;
+
+	request[0] = header;
+	for (i = 1; i < n; i++)
+		request[i] = 0;
+	for (i = 0; i < len; i++)
+		request[(i + 3) / 4] |= (quadlet_t) operands[i] << (24 - ((i + 3) % 4) * 8);
+	return n;
+}
+
+/*
+ * Copy up to len operand bytes of a response, starting at operand offset.
+ * RETURNS:	the number of bytes copied.
+ */
+int unpack_response(const quadlet_t *response, int response_len, int offset,
+                    unsigned char *operands, int len)
+{
+	int i, available = response_len * 4 - 3 - offset;
+
+	if (len > available)
+		len = available > 0 ? available : 0;
+	for (i = 0; i < len; i++)
+		operands[i] = response[(offset + i + 3) / 4]
+			>> (24 - ((offset + i + 3) % 4) * 8);
+	return len;
+}
+
+/* request and response codes to their AVC1394_CT_... and AVC1394_RC_... */
+static const unsigned char ctype_ids[16] = {
+#define AVC1394_CTYPE(code, id, name) [code] = AVC1394_CT_##id,
+#include "avc1394_commands.def"
+};
+
+static const unsigned char response_ids[16] = {
+#define AVC1394_RESPONSE(code, id, name) [code] = AVC1394_RC_##id,
+#include "avc1394_commands.def"
+};
+
+static const char *const ctype_names[] = {
+	[AVC1394_CT_UNKNOWN] = "UNKNOWN CTYPE",
+#define AVC1394_CTYPE(code, id, name) [AVC1394_CT_##id] = name,
+#include "avc1394_commands.def"
+};
+
+static const char *const response_names[] = {
+	[AVC1394_RC_UNKNOWN] = "UNKNOWN RESPONSE",
+#define AVC1394_RESPONSE(code, id, name) [AVC1394_RC_##id] = name,
+#include "avc1394_commands.def"
+};
+
+enum avc1394_ctype_id avc1394_decode_ctype(quadlet_t request)
+{
+	return ctype_ids[AVC1394_MASK_CTYPE(request) >> 24];
+}
+
+enum avc1394_response_id avc1394_decode_response(quadlet_t response)
+{
+	return response_ids[AVC1394_GET_RESPONSE(response)];
+}
+
+const char *avc1394_ctype_name(enum avc1394_ctype_id ctype)
+{
+	if ((unsigned int) ctype >= sizeof(ctype_names) / sizeof(ctype_names[0]))
+		ctype = AVC1394_CT_UNKNOWN;
+	return ctype_names[ctype];
+}
+
+const char *avc1394_response_name(enum avc1394_response_id response)
+{
+	if ((unsigned int) response >= sizeof(response_names) / sizeof(response_names[0]))
+		response = AVC1394_RC_UNKNOWN;
+	return response_names[response];
+}
+
 /* used for debug output */
 char *decode_response(quadlet_t response)
 {
-	quadlet_t resp = AVC1394_MASK_RESPONSE(response);
-	if (resp == AVC1394_RESPONSE_NOT_IMPLEMENTED)
-		return "NOT IMPLEMENTED";
-	if (resp == AVC1394_RESPONSE_ACCEPTED)
-		return "ACCEPTED";
-	if (resp == AVC1394_RESPONSE_REJECTED)
-		return "REJECTED";
-	if (resp == AVC1394_RESPONSE_IN_TRANSITION)
-		return "IN TRANSITION";
-	if (resp == AVC1394_RESPONSE_IMPLEMENTED)
-		return "IMPLEMENTED / STABLE";
-	if (resp == AVC1394_RESPONSE_CHANGED)
-		return "CHANGED";
-	if (resp == AVC1394_RESPONSE_INTERIM)
-		return "INTERIM";
-	return "UNKNOWN RESPONSE";
+	return (char *) avc1394_response_name(avc1394_decode_response(response));
 }
 
 /* used for debug output */
 char *decode_ctype(quadlet_t command)
 {
-	quadlet_t resp = AVC1394_MASK_CTYPE(command);
-	if (resp == AVC1394_CTYPE_CONTROL)
-		return "CONTROL";
-	if (resp == AVC1394_CTYPE_STATUS)
-		return "STATUS";
-	if (resp == AVC1394_CTYPE_SPECIFIC_INQUIRY)
-		return "SPECIFIC INQUIRY";
-	if (resp == AVC1394_CTYPE_NOTIFY)
-		return "NOTIFY";
-	if (resp == AVC1394_CTYPE_GENERAL_INQUIRY)
-		return "GENERAL INQUIRY";
-	return "UNKOWN CTYPE";
+	return (char *) avc1394_ctype_name(avc1394_decode_ctype(command));
+}
+
+/*
+ * The outstanding non-blocking transactions of each handle. They are kept
+ * here rather than in the handle's userdata, which the blocking transactions
+ * take over for their response.
+ */
+struct pending_list {
+	raw1394handle_t handle;
+	avc1394_pending *first;
+	struct pending_list *next;
+};
+
+static struct pending_list *pending_lists;
+
+static struct pending_list **find_list(raw1394handle_t handle)
+{
+	struct pending_list **link;
+
+	for (link = &pending_lists; *link != NULL; link = &(*link)->next)
+		if ((*link)->handle == handle)
+			break;
+	return link;
+}
+
+avc1394_pending *pending_first(raw1394handle_t handle)
+{
+	struct pending_list *l = *find_list(handle);
+
+	return l != NULL ? l->first : NULL;
+}
+
+/* append to the list of its handle; returns 1 if it is the only one,
+   0 if others are outstanding, or -1 */
+int pending_link(avc1394_pending *pending)
+{
+	struct pending_list **link = find_list(pending->handle);
+	avc1394_pending *q;
+
+	pending->next = NULL;
+	if (*link == NULL) {
+		*link = calloc(1, sizeof(struct pending_list));
+		if (*link == NULL)
+			return -1;
+		(*link)->handle = pending->handle;
+		(*link)->first = pending;
+		return 1;
+	}
+	for (q = (*link)->first; q->next != NULL; q = q->next)
+		;
+	q->next = pending;
+	return 0;
+}
+
+/* returns 1 if no transaction is left outstanding on its handle */
+int pending_unlink(avc1394_pending *pending)
+{
+	struct pending_list *l, **link = find_list(pending->handle);
+	avc1394_pending **q;
+
+	if ((l = *link) == NULL)
+		return 1;
+	for (q = &l->first; *q != NULL; q = &(*q)->next)
+		if (*q == pending) {
+			*q = pending->next;
+			break;
+		}
+	if (l->first != NULL)
+		return 0;
+	*link = l->next;
+	free(l);
+	return 1;
 }
 
 int avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
@@ -85,8 +215,14 @@ int avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
 	if (response && length > 3) {
 		struct fcp_response *fr = raw1394_get_userdata(handle);
 		
+		/* outstanding non-blocking transactions, armed NOTIFYs among
+		   them, keep their responses */
+		if (pending_dispatch(handle, nodeid, length, data))
+			return 0;
+
 		/* if not interim, then shut down fcp handler asap to minimize overlapped fcp transactions */
-		if (AVC1394_MASK_RESPONSE( ntohl( ((quadlet_t*)data)[0] ) ) != AVC1394_RESPONSE_INTERIM)
+		if (AVC1394_MASK_RESPONSE( ntohl( ((quadlet_t*)data)[0] ) ) != AVC1394_RESPONSE_INTERIM
+				&& pending_first(handle) == NULL)
 			raw1394_stop_fcp_listen(handle);
 
 		if (fr->length == 0) {
@@ -94,6 +230,8 @@ int avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
 				fr->length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
 			else
 				fr->length = 0;
+			if (length > MAX_RESPONSE_SIZE)
+				length = MAX_RESPONSE_SIZE;
 			memcpy(fr->data, data, length);
 		}
 	}
@@ -104,10 +242,143 @@ void init_avc_response_handler(raw1394handle_t handle, struct fcp_response *resp
 {
 	raw1394_set_userdata(handle, response);
 	raw1394_set_fcp_handler(handle, avc_fcp_handler);
-	raw1394_start_fcp_listen(handle);
+	/* outstanding transactions keep the handle listening */
+	if (pending_first(handle) == NULL)
+		raw1394_start_fcp_listen(handle);
 }
 
+/* hand the handle back to the outstanding transactions, if there are any */
 void stop_avc_response_handler(raw1394handle_t handle)
 {
-	raw1394_stop_fcp_listen(handle);
+	if (pending_first(handle) != NULL)
+		raw1394_set_fcp_handler(handle, pending_fcp_handler);
+	else
+		raw1394_stop_fcp_listen(handle);
+}
+
+/* Give a response to the oldest outstanding transaction for its node,
+   subunit and opcode that it echoes the operands of. Returns 1 if one took
+   it. */
+int pending_dispatch(raw1394handle_t handle, nodeid_t nodeid,
+                     size_t length, unsigned char *data)
+{
+	struct avc1394_pending_struct *p;
+	quadlet_t q;
+
+	if (length < sizeof(quadlet_t))
+		return 0;
+	q = ntohl(((quadlet_t*)data)[0]);
+
+	for (p = pending_first(handle); p != NULL; p = p->next) {
+		if (!p->issued || p->done || (p->node & 0x3f) != (nodeid & 0x3f)
+				|| (q & 0x00FFFF00) != (ntohl(*(quadlet_t *) p->request) & 0x00FFFF00))
+			continue;
+		if (p->match && (length < 3 + (size_t) p->match
+				|| memcmp(data + 3, p->request + 3, p->match) != 0))
+			continue;
+		/* a NOTIFY past its INTERIM takes only CHANGED, and only it does */
+		if ((p->notify && p->interim)
+				!= (AVC1394_MASK_RESPONSE(q) == AVC1394_RESPONSE_CHANGED))
+			continue;
+		if (AVC1394_MASK_RESPONSE(q) == AVC1394_RESPONSE_INTERIM) {
+			p->interim = 1;
+		} else {
+			if (length > AVC1394_FRAME_MAX)
+				length = AVC1394_FRAME_MAX;
+			memcpy(p->received, data, length);
+			p->received_length = length;
+			clock_gettime(CLOCK_MONOTONIC, &p->answered);
+			p->done = 1;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+int pending_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
+                        size_t length, unsigned char *data)
+{
+	if (response)
+		pending_dispatch(handle, nodeid, length, data);
+	return 0;
+}
+
+
+/* Call before reading what is to be watched; set valid once it is read. */
+void watch_start(struct watched *watched, raw1394handle_t handle)
+{
+	watched->handle = handle;
+	watched->generation = raw1394_get_generation(handle);
+	watched->valid = 0;
+}
+
+/* Arm a NOTIFY, frame in network byte order as for pending_start_match(),
+   unless one is armed already or the device has refused it. */
+void watch_arm(struct watched *watched, nodeid_t node,
+               const quadlet_t *frame, int len, int match)
+{
+	if (watched->notify == NULL && !watched->refused)
+		watched->notify = pending_start_match(watched->handle, node,
+			frame, len, match);
+}
+
+void watch_stop(struct watched *watched)
+{
+	if (watched->notify != NULL)
+		avc1394_transaction_finish(watched->notify);
+	watched->notify = NULL;
+	watched->valid = 0;
+	watched->refused = 0;
+}
+
+/* Finish the answered NOTIFY, arming the same again after CHANGED if
+   rearm is set. Returns 1 if it was CHANGED. */
+static int watch_answered(struct watched *watched, int rearm)
+{
+	avc1394_pending *p = watched->notify;
+	int changed = AVC1394_MASK_RESPONSE(avc1394_transaction_response(p, NULL)[0])
+		== AVC1394_RESPONSE_CHANGED;
+
+	watched->notify = NULL;
+	if (!changed)
+		watched->refused = 1;
+	else if (rearm)
+		watched->notify = pending_start_match(watched->handle, p->node,
+			(quadlet_t *) p->request, p->request_len, p->match);
+	avc1394_transaction_finish(p);
+	return changed;
+}
+
+/* stop watching what was read before a bus reset */
+static int watch_current(struct watched *watched)
+{
+	if (watched->valid
+			&& raw1394_get_generation(watched->handle) != watched->generation)
+		watch_stop(watched);
+	return watched->valid;
+}
+
+/* Returns 1 if what is watched is still current. Only looks at what has
+   already arrived, so it costs no traffic. */
+int watch_check(struct watched *watched)
+{
+	if (watch_current(watched) && watched->notify != NULL
+			&& avc1394_transaction_poll(watched->notify, 0)
+			&& watch_answered(watched, 0))
+		watched->valid = 0;
+	return watched->valid;
+}
+
+/* After a change of our own that the device accepted: take the CHANGED it
+   causes and arm the NOTIFY again, so that what is watched can be updated
+   in place. Returns 0 if it is to be read again instead. */
+int watch_absorb(struct watched *watched)
+{
+	if (!watch_current(watched))
+		return 0;
+	/* a CHANGED still to come drops it on a later check */
+	if (watched->notify != NULL
+			&& avc1394_transaction_poll(watched->notify, AVC1394_POLL_TIMEOUT))
+		watch_answered(watched, 1);
+	return 1;
 }
@@ -5,10 +5,12 @@
 #define FCP_COMMAND_ADDR 0xFFFFF0000B00ULL
 #define FCP_RESPONSE_ADDR 0xFFFFF0000D00ULL
 
-#define MAX_RESPONSE_SIZE 512
+#define MAX_RESPONSE_SIZE AVC1394_FRAME_MAX
 #define AVC1394_RETRY 2
 #define AVC1394_SLEEP 10000
 #define AVC1394_POLL_TIMEOUT 200
+/* how long to keep waiting for the final response after an INTERIM one */
+#define AVC1394_INTERIM_TIMEOUT 2000
 /* #define DEBUG */
 
 struct fcp_response {
@@ -16,11 +18,88 @@ struct fcp_response {
 	unsigned int length;
 };
 
+/* a request of up to two quadlets, laid out byte by byte in network order
+   when it is compiled, so it can be sent from static memory as it is */
+struct fcp_frame {
+	int len;		/* quadlets */
+	union {
+		unsigned char bytes[8];
+		quadlet_t quadlets[2];
+	} data;
+};
+
+#define FCP_FRAME(len, header, operand, extra) \
+	{ (len), { { ((header) >> 24) & 0xFF, ((header) >> 16) & 0xFF, \
+	  ((header) >> 8) & 0xFF, (operand) & 0xFF, ((extra) >> 24) & 0xFF, \
+	  ((extra) >> 16) & 0xFF, ((extra) >> 8) & 0xFF, (extra) & 0xFF } } }
+
+/* a non-blocking transaction, linked into the list of its handle */
+struct avc1394_pending_struct {
+	raw1394handle_t handle;
+	nodeid_t node;
+	int notify;		/* a NOTIFY, waits for CHANGED after its INTERIM */
+	int interim;
+	int done;
+	struct timespec sent;	/* CLOCK_MONOTONIC */
+	struct timespec answered;
+	unsigned char received[AVC1394_FRAME_MAX];	/* final response, wire order */
+	unsigned int received_length;
+	int converted;		/* fr holds received in host byte order */
+	unsigned char request[AVC1394_FRAME_MAX];	/* as sent, wire order */
+	int request_len;	/* quadlets */
+	int issued;		/* written, see pending_send() */
+	int match;		/* leading operands a response must echo */
+	struct fcp_response fr;
+	struct avc1394_pending_struct *next;
+};
+
+/* Something read from a device, kept until a bus reset or, while a NOTIFY
+   is armed on it, until the device answers that with CHANGED. A device
+   that refuses the NOTIFY is not asked again until a bus reset. */
+struct watched {
+	raw1394handle_t handle;
+	unsigned int generation;	/* of the bus it was read on */
+	int valid;
+	int refused;		/* the device would not take the NOTIFY */
+	avc1394_pending *notify;	/* armed NOTIFY, if any */
+};
+
 void htonl_block(quadlet_t *buf, int len);
 void ntohl_block(quadlet_t *buf, int len);
+int pack_request(quadlet_t *request, quadlet_t header,
+                 const unsigned char *operands, int len);
+int unpack_response(const quadlet_t *response, int response_len, int offset,
+                    unsigned char *operands, int len);
 char *decode_response(quadlet_t response);
 char *decode_ctype(quadlet_t response);
 int avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
                     size_t length, unsigned char *data);
 void init_avc_response_handler(raw1394handle_t handle, struct fcp_response *response);
 void stop_avc_response_handler(raw1394handle_t handle);
+int send_frame(raw1394handle_t handle, nodeid_t node, const quadlet_t *frame, int len);
+avc1394_pending *pending_start_frame(raw1394handle_t handle, nodeid_t node,
+                                     const quadlet_t *frame, int len);
+avc1394_pending *pending_open(raw1394handle_t handle, nodeid_t node,
+                              const quadlet_t *frame, int len, int match);
+int pending_send(avc1394_pending *pending);
+avc1394_pending *pending_start_match(raw1394handle_t handle, nodeid_t node,
+                                     const quadlet_t *frame, int len, int match);
+avc1394_pending *pending_command(raw1394handle_t handle, nodeid_t node,
+                                 quadlet_t header, unsigned char *operands, int len);
+avc1394_pending *pending_first(raw1394handle_t handle);
+int pending_link(avc1394_pending *pending);
+int pending_unlink(avc1394_pending *pending);
+int pending_dispatch(raw1394handle_t handle, nodeid_t nodeid,
+                     size_t length, unsigned char *data);
+int pending_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, int response,
+                        size_t length, unsigned char *data);
+void watch_start(struct watched *watched, raw1394handle_t handle);
+void watch_arm(struct watched *watched, nodeid_t node,
+               const quadlet_t *frame, int len, int match);
+int watch_check(struct watched *watched);
+int watch_absorb(struct watched *watched);
+void watch_stop(struct watched *watched);
+void descriptor_watch(struct watched *watched, nodeid_t node, quadlet_t subunit,
+                      unsigned char *specifier, int specifier_len);
+int vendor_dispatch(nodeid_t node, const avc1394_frame *request,
+                    avc1394_frame *response);
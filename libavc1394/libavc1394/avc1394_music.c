@@ -0,0 +1,476 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_music.c - read the status descriptor and plugs of a music
+ * subunit in one pass, and keep them per device until they change.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+#include "../common/raw1394util.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+#define UNIT (AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE)
+#define MUSIC (AVC1394_SUBUNIT_TYPE_MUSIC | AVC1394_SUBUNIT_ID_0)
+
+/* the two GUID quadlets of the bus info block */
+#define CONFIG_ROM_GUID_ADDR 0xFFFFF000040CULL
+
+/* info blocks of the status descriptor */
+#define INFO_GENERAL_STATUS 0x8100
+#define INFO_ROUTING_STATUS 0x8108
+#define INFO_SUBUNIT_PLUG 0x8109
+#define INFO_CLUSTER 0x810A
+#define INFO_MUSIC_PLUG 0x810B
+
+/* the primary fields used of each */
+#define GENERAL_STATUS_FIELDS 2
+#define ROUTING_STATUS_FIELDS 4
+#define SUBUNIT_PLUG_FIELDS 8
+#define CLUSTER_FIELDS 3
+#define SIGNAL_FIELDS 4
+#define MUSIC_PLUG_FIELDS 14
+
+static unsigned char status_specifier[] = {
+	AVC1394_OPERAND_DESCRIPTOR_TYPE_MUSIC_STATUS_DESCRIPTOR
+};
+
+/* The descriptor is walked twice: counting with status NULL, then filling
+   in the arrays sized by the count */
+struct music_parse {
+	avc1394_music_status *status;
+	avc1394_music_cluster *clusters;
+	avc1394_music_signal *signals;
+	int plug_count;
+	int cluster_count;
+	int signal_count;
+	int music_plug_count;
+};
+
+static int be16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+/* Split the info block at p, of at most len bytes, into its type, primary
+   fields and nested info blocks. Returns its length, or -1. */
+static int info_block(unsigned char *p, int len, int *type,
+	unsigned char **primary, int *primary_len,
+	unsigned char **nested, int *nested_len)
+{
+	int compound, fields;
+
+	if (len < 6)
+		return -1;
+	compound = be16(p);
+	fields = be16(p + 4);
+	if (compound < 4 || 2 + compound > len || 4 + fields > compound)
+		return -1;
+	*type = be16(p + 2);
+	*primary = p + 6;
+	*primary_len = fields;
+	*nested = p + 6 + fields;
+	*nested_len = compound - 4 - fields;
+	return 2 + compound;
+}
+
+static void parse_end(const unsigned char *p, avc1394_music_plug_end *end)
+{
+	end->function_type = p[0];
+	end->plug = p[1];
+	end->function_block = p[2];
+	end->stream_position = p[3];
+	end->stream_location = p[4];
+}
+
+/* the cluster info blocks nested in a subunit plug's */
+static int parse_clusters(struct music_parse *state,
+	avc1394_music_subunit_plug *plug, unsigned char *p, int len)
+{
+	avc1394_music_cluster *cluster;
+	avc1394_music_signal *signal;
+	unsigned char *primary, *nested;
+	int primary_len, nested_len, type, n, i;
+
+	for (; len > 0; p += n, len -= n) {
+		n = info_block(p, len, &type, &primary, &primary_len,
+			&nested, &nested_len);
+		if (n < 0)
+			return -1;
+		if (type != INFO_CLUSTER)
+			continue;
+		if (primary_len < CLUSTER_FIELDS
+				|| primary_len < CLUSTER_FIELDS + SIGNAL_FIELDS * primary[2])
+			return -1;
+		if (state->status != NULL) {
+			cluster = &state->clusters[state->cluster_count];
+			cluster->stream_format = primary[0];
+			cluster->port_type = primary[1];
+			cluster->count = primary[2];
+			cluster->signals = &state->signals[state->signal_count];
+			for (i = 0; i < cluster->count; i++) {
+				signal = &cluster->signals[i];
+				signal->music_plug_id = be16(primary + CLUSTER_FIELDS
+					+ SIGNAL_FIELDS * i);
+				signal->stream_position = primary[CLUSTER_FIELDS
+					+ SIGNAL_FIELDS * i + 2];
+				signal->stream_location = primary[CLUSTER_FIELDS
+					+ SIGNAL_FIELDS * i + 3];
+			}
+			plug->count++;
+		}
+		state->cluster_count++;
+		state->signal_count += primary[2];
+	}
+	return 0;
+}
+
+/* The subunit plug and music plug info blocks of the routing status. The
+   destination plugs come before the source plugs. */
+static int parse_routing(struct music_parse *state, unsigned char *fields,
+	int fields_len, unsigned char *p, int len)
+{
+	avc1394_music_subunit_plug *plug = NULL;
+	avc1394_music_plug *music;
+	unsigned char *primary, *nested;
+	int primary_len, nested_len, type, n, index = 0;
+
+	if (fields_len < ROUTING_STATUS_FIELDS)
+		return -1;
+	for (; len > 0; p += n, len -= n) {
+		n = info_block(p, len, &type, &primary, &primary_len,
+			&nested, &nested_len);
+		if (n < 0)
+			return -1;
+		switch (type) {
+		case INFO_SUBUNIT_PLUG:
+			if (primary_len < SUBUNIT_PLUG_FIELDS)
+				return -1;
+			if (state->status != NULL) {
+				plug = &state->status->subunit_plugs[state->plug_count];
+				plug->source = index >= fields[0];
+				plug->id = primary[0];
+				plug->signal_format = be16(primary + 1);
+				plug->type = primary[3];
+				plug->channels = be16(primary + 6);
+				plug->count = 0;
+				plug->clusters = &state->clusters[state->cluster_count];
+			}
+			if (parse_clusters(state, plug, nested, nested_len) < 0)
+				return -1;
+			state->plug_count++;
+			index++;
+			break;
+		case INFO_MUSIC_PLUG:
+			if (primary_len < MUSIC_PLUG_FIELDS)
+				return -1;
+			if (state->status != NULL) {
+				music = &state->status->music_plugs[state->music_plug_count];
+				music->type = primary[0];
+				music->id = be16(primary + 1);
+				music->routing_support = primary[3];
+				parse_end(primary + 4, &music->source);
+				parse_end(primary + 9, &music->destination);
+			}
+			state->music_plug_count++;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int parse_status(struct music_parse *state, unsigned char *p, int len)
+{
+	unsigned char *primary, *nested;
+	int primary_len, nested_len, type, n;
+
+	for (; len > 0; p += n, len -= n) {
+		n = info_block(p, len, &type, &primary, &primary_len,
+			&nested, &nested_len);
+		if (n < 0)
+			return -1;
+		if (type == INFO_GENERAL_STATUS) {
+			if (primary_len < GENERAL_STATUS_FIELDS)
+				return -1;
+			if (state->status != NULL) {
+				state->status->transmit_capability = primary[0];
+				state->status->receive_capability = primary[1];
+			}
+		} else if (type == INFO_ROUTING_STATUS) {
+			if (parse_routing(state, primary, primary_len,
+					nested, nested_len) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+avc1394_music_status *avc1394_music_status_parse(unsigned char *descriptor,
+	int length)
+{
+	struct music_parse count, fill;
+	avc1394_music_status *status;
+	int len;
+
+	if (length < 2)
+		return NULL;
+	len = be16(descriptor);
+	if (len > length - 2)
+		return NULL;
+
+	memset(&count, 0, sizeof(count));
+	if (parse_status(&count, descriptor + 2, len) < 0)
+		return NULL;
+
+	/* the arrays with pointers first, to keep them aligned */
+	status = calloc(1, sizeof(avc1394_music_status)
+		+ count.plug_count * sizeof(avc1394_music_subunit_plug)
+		+ count.cluster_count * sizeof(avc1394_music_cluster)
+		+ count.music_plug_count * sizeof(avc1394_music_plug)
+		+ count.signal_count * sizeof(avc1394_music_signal));
+	if (status == NULL)
+		return NULL;
+	status->subunit_plugs = (avc1394_music_subunit_plug *) (status + 1);
+	status->music_plugs = (avc1394_music_plug *) ((avc1394_music_cluster *)
+		(status->subunit_plugs + count.plug_count) + count.cluster_count);
+
+	memset(&fill, 0, sizeof(fill));
+	fill.status = status;
+	fill.clusters = (avc1394_music_cluster *)
+		(status->subunit_plugs + count.plug_count);
+	fill.signals = (avc1394_music_signal *)
+		(status->music_plugs + count.music_plug_count);
+	parse_status(&fill, descriptor + 2, len);
+	status->plug_count = fill.plug_count;
+	status->music_plug_count = fill.music_plug_count;
+	return status;
+}
+
+static avc1394_pending *start_plug_info(raw1394handle_t handle, nodeid_t node,
+	quadlet_t subunit)
+{
+	unsigned char operands[5] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+	quadlet_t request[2];
+	int len;
+
+	len = pack_request(request,
+		AVC1394_CTYPE_STATUS | subunit | AVC1394_COMMAND_PLUG_INFO,
+		operands, 5);
+	return avc1394_transaction_start(handle, node, request, len);
+}
+
+/* collect and release a PLUG INFO; returns 0, or -1 */
+static int finish_plug_info(avc1394_pending *p, avc1394_plugs *info)
+{
+	unsigned char operands[5];
+	quadlet_t *response;
+	unsigned int len;
+	int result = -1;
+
+	if (p == NULL)
+		return -1;
+	if (avc1394_transaction_wait(p) == AVC1394_RESP_STABLE) {
+		response = avc1394_transaction_response(p, &len);
+		if (unpack_response(response, len, 0, operands, 5) == 5) {
+			info->iso_inputs = operands[1];
+			info->iso_outputs = operands[2];
+			info->external_inputs = operands[3];
+			info->external_outputs = operands[4];
+			result = 0;
+		}
+	}
+	avc1394_transaction_finish(p);
+	return result;
+}
+
+/* returns 0 if the GUID could not be read */
+static octlet_t read_guid(raw1394handle_t handle, nodeid_t node)
+{
+	quadlet_t guid[2];
+
+	/* some old nodes only answer quadlet reads in config ROM */
+	if (cooked1394_read(handle, 0xffc0 | node, CONFIG_ROM_GUID_ADDR,
+			sizeof(guid), guid) < 0
+			&& (cooked1394_read(handle, 0xffc0 | node, CONFIG_ROM_GUID_ADDR,
+				sizeof(quadlet_t), &guid[0]) < 0
+			|| cooked1394_read(handle, 0xffc0 | node, CONFIG_ROM_GUID_ADDR + 4,
+				sizeof(quadlet_t), &guid[1]) < 0))
+		return 0;
+	return ((octlet_t) ntohl(guid[0]) << 32) | ntohl(guid[1]);
+}
+
+avc1394_music_status *avc1394_music_status_read(raw1394handle_t handle,
+	nodeid_t node)
+{
+	avc1394_music_status *status = NULL;
+	avc1394_pending *unit, *music;
+	avc1394_plugs unit_plugs, plugs;
+	unsigned char *descriptor;
+	octlet_t guid;
+	int length, failed;
+
+	/* the PLUG INFOs go first and are answered while the GUID and the
+	   descriptor are read */
+	unit = start_plug_info(handle, node, UNIT);
+	music = start_plug_info(handle, node, MUSIC);
+	guid = read_guid(handle, node);
+
+	descriptor = malloc(AVC1394_DESCRIPTOR_MAX);
+	if (descriptor != NULL) {
+		length = avc1394_descriptor_read(handle, node, MUSIC,
+			status_specifier, sizeof(status_specifier),
+			descriptor, AVC1394_DESCRIPTOR_MAX);
+		if (length >= 0)
+			status = avc1394_music_status_parse(descriptor,
+				length < AVC1394_DESCRIPTOR_MAX ? length
+				: AVC1394_DESCRIPTOR_MAX);
+		free(descriptor);
+	}
+
+	failed = finish_plug_info(unit, &unit_plugs) < 0;
+	failed |= finish_plug_info(music, &plugs) < 0;
+
+#ifdef DEBUG
+	fprintf(stderr, "avc1394_music_status_read: node %d, guid %016llx, %s\n",
+		node & 0x3f, (unsigned long long) guid,
+		status == NULL ? "no status" : failed ? "no plug info" : "ok");
+#endif
+
+	if (status == NULL || failed || guid == 0) {
+		free(status);
+		return NULL;
+	}
+	status->guid = guid;
+	status->unit_plugs = unit_plugs;
+	status->plugs = plugs;
+	return status;
+}
+
+
+struct music_entry {
+	nodeid_t node;
+	avc1394_music_status *status;
+	struct watched watched;
+	struct music_entry *next;
+};
+
+struct avc1394_music_cache_struct {
+	raw1394handle_t handle;
+	int watch;
+	struct music_entry *entries;
+};
+
+static void drop_entry(struct music_entry *e)
+{
+	watch_stop(&e->watched);
+	free(e->status);
+	free(e);
+}
+
+avc1394_music_cache *avc1394_music_cache_new(raw1394handle_t handle, int watch)
+{
+	avc1394_music_cache *cache = calloc(1, sizeof(avc1394_music_cache));
+
+	if (cache == NULL)
+		return NULL;
+	cache->handle = handle;
+	cache->watch = watch;
+	return cache;
+}
+
+void avc1394_music_cache_flush(avc1394_music_cache *cache)
+{
+	struct music_entry *e;
+
+	while ((e = cache->entries) != NULL) {
+		cache->entries = e->next;
+		drop_entry(e);
+	}
+}
+
+void avc1394_music_cache_free(avc1394_music_cache *cache)
+{
+	avc1394_music_cache_flush(cache);
+	free(cache);
+}
+
+/* The current entry for guid, or with guid 0 for node. Entries that are no
+   longer current are dropped on the way. */
+static struct music_entry *cache_lookup(avc1394_music_cache *cache,
+	octlet_t guid, nodeid_t node)
+{
+	struct music_entry *e, **link = &cache->entries;
+
+	while ((e = *link) != NULL) {
+		if (guid != 0 ? e->status->guid != guid
+				: (e->node & 0x3f) != (node & 0x3f)) {
+			link = &e->next;
+			continue;
+		}
+		if (watch_check(&e->watched))
+			return e;
+		*link = e->next;
+		drop_entry(e);
+	}
+	return NULL;
+}
+
+avc1394_music_status *avc1394_music_cache_get(avc1394_music_cache *cache,
+	nodeid_t node)
+{
+	struct music_entry *e = cache_lookup(cache, 0, node);
+
+	if (e != NULL)
+		return e->status;
+
+	e = calloc(1, sizeof(struct music_entry));
+	if (e == NULL)
+		return NULL;
+	watch_start(&e->watched, cache->handle);
+	e->status = avc1394_music_status_read(cache->handle, node);
+	if (e->status == NULL) {
+		free(e);
+		return NULL;
+	}
+	e->node = node;
+	e->watched.valid = 1;
+	if (cache->watch)
+		descriptor_watch(&e->watched, node, MUSIC,
+			status_specifier, sizeof(status_specifier));
+
+	e->next = cache->entries;
+	cache->entries = e;
+	return e->status;
+}
+
+avc1394_music_status *avc1394_music_cache_find(avc1394_music_cache *cache,
+	octlet_t guid)
+{
+	struct music_entry *e;
+
+	if (guid == 0)
+		return NULL;
+	e = cache_lookup(cache, guid, 0);
+	return e != NULL ? e->status : NULL;
+}
@@ -0,0 +1,377 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_panel.c - panel subunit pass-through: key sequences for
+ * set-top boxes and other remote controlled devices.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_panel.h"
+#include "avc1394_internal.h"
+
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+#define PANEL_SUBUNIT (AVC1394_SUBUNIT_TYPE_PANEL | AVC1394_SUBUNIT_ID_0)
+
+static long elapsed_ms(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000
+		+ (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void add_ms(struct timespec *at, long ms)
+{
+	at->tv_sec += ms / 1000;
+	at->tv_nsec += (ms % 1000) * 1000000L;
+	if (at->tv_nsec >= 1000000000L) {
+		at->tv_sec++;
+		at->tv_nsec -= 1000000000L;
+	}
+}
+
+void avc1394_panel_init(avc1394_panel *panel, raw1394handle_t handle, nodeid_t node)
+{
+	panel->handle = handle;
+	panel->node = node;
+	panel->gap = AVC1394_PANEL_DEFAULT_GAP;
+	panel->hold = AVC1394_PANEL_DEFAULT_GAP / 2;
+	panel->press_only = 0;
+	panel->tune_function = -1;
+}
+
+int avc1394_panel_build_pass_through(unsigned char operation, int release,
+	const unsigned char *data, int data_len, quadlet_t *request)
+{
+	int i, len = 2 + data_len / 4;
+
+	request[0] = AVC1394_CTYPE_CONTROL | PANEL_SUBUNIT
+		| AVC1394_PANEL_COMMAND_PASS_THROUGH
+		| (release ? AVC1394_PANEL_OPERAND_RELEASE : AVC1394_PANEL_OPERAND_PRESS)
+		| (operation & 0x7f);
+
+	/* operation_data_field_length, then the data, zero padded */
+	for (i = 1; i < len; i++)
+		request[i] = 0;
+	request[1] = data_len << 24;
+	for (i = 0; i < data_len; i++)
+		request[1 + (i + 1) / 4] |= data[i] << (24 - ((i + 1) % 4) * 8);
+	return len;
+}
+
+int avc1394_panel_calibrate(avc1394_panel *panel)
+{
+	quadlet_t request[2];
+	struct timespec start;
+	avc1394_pending *p;
+	long rtt, slowest = 0;
+	int i;
+
+	/* asking whether SELECT is implemented presses nothing */
+	request[0] = AVC1394_CTYPE_SPECIFIC_INQUIRY | PANEL_SUBUNIT
+		| AVC1394_PANEL_COMMAND_PASS_THROUGH | AVC1394_PANEL_OPERATION_SELECT;
+	request[1] = 0;
+
+	for (i = 0; i < AVC1394_PANEL_CALIBRATE_SAMPLES; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		p = avc1394_transaction_start(panel->handle, panel->node, request, 2);
+		if (p == NULL)
+			return -1;
+		if (avc1394_transaction_wait(p) < 0) {
+			avc1394_transaction_finish(p);
+			return -1;
+		}
+		rtt = elapsed_ms(&start);
+		avc1394_transaction_finish(p);
+		if (rtt > slowest)
+			slowest = rtt;
+	}
+
+	panel->gap = 2 * slowest;
+	if (panel->gap < AVC1394_PANEL_MIN_GAP)
+		panel->gap = AVC1394_PANEL_MIN_GAP;
+	panel->hold = panel->gap / 2;
+#ifdef DEBUG
+	fprintf(stderr, "panel calibrated: round-trip %ldms, gap %dms\n",
+		slowest, panel->gap);
+#endif
+	return panel->gap;
+}
+
+/* fill in the press (and release) events for a key sequence starting at
+   start; returns the number of entries used */
+static int panel_schedule(avc1394_panel *panel, const unsigned char *operations,
+	int count, int release, const struct timespec *start,
+	avc1394_sequence_entry *entries, quadlet_t (*requests)[2])
+{
+	int i, events = 0;
+
+	for (i = 0; i < count; i++) {
+		avc1394_sequence_entry *e = &entries[events];
+
+		avc1394_panel_build_pass_through(operations[i], 0, NULL, 0,
+			requests[events]);
+		memset(e, 0, sizeof(avc1394_sequence_entry));
+		e->handle = panel->handle;
+		e->node = panel->node;
+		e->request = requests[events++];
+		e->len = 2;
+		e->at = *start;
+		add_ms(&e->at, (long) i * panel->gap);
+		if (release) {
+			avc1394_panel_build_pass_through(operations[i], 1, NULL, 0,
+				requests[events]);
+			e[1] = e[0];
+			e[1].request = requests[events++];
+			add_ms(&e[1].at, panel->hold);
+		}
+	}
+	return events;
+}
+
+/* the keypad operations for number; returns their count or -1 */
+static int panel_digit_keys(int number, int digits, unsigned char *operations)
+{
+	int i, n = 0;
+
+	if (number < 0)
+		return -1;
+	for (i = number; i > 0 || n < digits || n == 0; i /= 10) {
+		if (n == AVC1394_PANEL_MAX_KEYS)
+			return -1;
+		n++;
+	}
+	for (i = n - 1; i >= 0; i--, number /= 10)
+		operations[i] = AVC1394_PANEL_OPERATION_0 + number % 10;
+	return n;
+}
+
+/* a TUNE FUNCTION for channel; returns its length or 0 if out of range */
+static int panel_tune_request(int channel, quadlet_t *request)
+{
+	unsigned char data[4];
+
+	if (channel < 0 || channel >= 0x1000)
+		return 0;
+	/* major channel number in 12 bits, no minor channel */
+	data[0] = (channel >> 8) & 0x0f;
+	data[1] = channel & 0xff;
+	data[2] = 0;
+	data[3] = 0;
+	return avc1394_panel_build_pass_through(AVC1394_PANEL_OPERATION_TUNE_FUNCTION,
+		0, data, 4, request);
+}
+
+int avc1394_panel_keys(avc1394_panel *panel, const unsigned char *operations,
+	int count, int release)
+{
+	avc1394_sequence_entry entries[2 * AVC1394_PANEL_MAX_KEYS];
+	quadlet_t requests[2 * AVC1394_PANEL_MAX_KEYS][2];
+	struct timespec start;
+	int i, k, n, events, failed = 0;
+
+	if (count <= 0)
+		return -1;
+
+	for (k = 0; k < count; k += n) {
+		n = count - k;
+		if (n > AVC1394_PANEL_MAX_KEYS)
+			n = AVC1394_PANEL_MAX_KEYS;
+
+		/* lay out the whole chunk on one time line and let the
+		   sequencer send it; responses are gathered at the end */
+		avc1394_sequence_time(&start, 0);
+		events = panel_schedule(panel, operations + k, n, release, &start,
+			entries, requests);
+		if (avc1394_sequence_run(entries, events, AVC1394_POLL_TIMEOUT) < 0)
+			return k == 0 ? -1 : failed + (count - k) * (release ? 2 : 1);
+		for (i = 0; i < events; i++)
+			if (entries[i].response != AVC1394_RESP_ACCEPTED)
+				failed++;
+	}
+	return failed;
+}
+
+int avc1394_panel_key(avc1394_panel *panel, unsigned char operation)
+{
+	return avc1394_panel_keys(panel, &operation, 1, 1);
+}
+
+int avc1394_panel_digits(avc1394_panel *panel, int number, int digits)
+{
+	unsigned char operations[AVC1394_PANEL_MAX_KEYS];
+	int n = panel_digit_keys(number, digits, operations);
+
+	if (n < 0)
+		return -1;
+	return avc1394_panel_keys(panel, operations, n, !panel->press_only);
+}
+
+int avc1394_panel_tune(avc1394_panel *panel, int channel, int digits)
+{
+	quadlet_t request[3];
+	avc1394_pending *p;
+	int len, result;
+
+	if (panel->tune_function != 0 && (len = panel_tune_request(channel, request)) > 0) {
+		p = avc1394_transaction_start(panel->handle, panel->node, request, len);
+		if (p == NULL)
+			return -1;
+		result = avc1394_transaction_wait(p);
+		avc1394_transaction_finish(p);
+		if (result == AVC1394_RESP_ACCEPTED) {
+			panel->tune_function = 1;
+			return 0;
+		}
+		/* one known to work has failed for this channel or this time;
+		   otherwise the device is taken not to have it */
+		if (panel->tune_function == 1 && result != AVC1394_RESP_NOT_IMPLEMENTED)
+			return -1;
+		panel->tune_function = 0;
+	}
+	return avc1394_panel_digits(panel, channel, digits) == 0 ? 0 : -1;
+}
+
+struct tune_slot {
+	avc1394_pending *pending;
+	int digits;		/* still to be entered on the keypad */
+	int first;		/* its events in the sequence */
+	int events;
+};
+
+int avc1394_panel_tune_all(avc1394_panel_tune_entry *tunes, int count, int digits)
+{
+	struct tune_slot *slots;
+	avc1394_sequence_entry *entries;
+	quadlet_t (*requests)[2];
+	quadlet_t request[3];
+	unsigned char operations[AVC1394_PANEL_MAX_KEYS];
+	struct timespec start, deadline, now, keys;
+	long us, last;
+	int i, j, n, len, events = 0, failed = 0;
+
+	if (count <= 0)
+		return 0;
+	slots = calloc(count, sizeof(struct tune_slot));
+	entries = calloc(count * 2 * AVC1394_PANEL_MAX_KEYS, sizeof(avc1394_sequence_entry));
+	requests = calloc(count * 2 * AVC1394_PANEL_MAX_KEYS, sizeof(*requests));
+	if (slots == NULL || entries == NULL || requests == NULL) {
+		free(slots);
+		free(entries);
+		free(requests);
+		return -1;
+	}
+
+	/* offer every device that may take it a tune function, all at once */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+		avc1394_panel *panel = tunes[i].panel;
+
+		tunes[i].result = -1;
+		tunes[i].latency = -1;
+		slots[i].digits = 1;
+		if (panel->tune_function != 0
+				&& (len = panel_tune_request(tunes[i].channel, request)) > 0) {
+			slots[i].pending = avc1394_transaction_start(panel->handle,
+				panel->node, request, len);
+			slots[i].digits = 0;
+		}
+	}
+	avc1394_sequence_time(&deadline, AVC1394_POLL_TIMEOUT);
+	for (i = 0; i < count; i++) {
+		avc1394_pending *p = slots[i].pending;
+
+		if (p == NULL)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		n = (deadline.tv_sec - now.tv_sec) * 1000
+			+ (deadline.tv_nsec - now.tv_nsec) / 1000000;
+		if (avc1394_transaction_poll(p, n > 0 ? n : 0)) {
+			switch (AVC1394_GET_RESPONSE(avc1394_transaction_response(p, NULL)[0])) {
+			case AVC1394_RESP_ACCEPTED:
+				tunes[i].panel->tune_function = 1;
+				tunes[i].result = 0;
+				tunes[i].latency = (p->answered.tv_sec - start.tv_sec) * 1000
+					+ (p->answered.tv_nsec - start.tv_nsec) / 1000000;
+				break;
+			case AVC1394_RESP_REJECTED:
+				/* only the channel, where it is known to work */
+				if (tunes[i].panel->tune_function == 1)
+					break;
+				/* fall through */
+			case AVC1394_RESP_NOT_IMPLEMENTED:
+				tunes[i].panel->tune_function = 0;
+				slots[i].digits = 1;
+				break;
+			}
+		} else if (!p->interim && tunes[i].panel->tune_function != 1) {
+			/* never answered, as in avc1394_panel_tune() */
+			tunes[i].panel->tune_function = 0;
+			slots[i].digits = 1;
+		}
+		avc1394_transaction_finish(p);
+	}
+
+	/* enter the rest on one time line, each device at its own pace */
+	avc1394_sequence_time(&keys, 0);
+	for (i = 0; i < count; i++) {
+		if (!slots[i].digits
+				|| (n = panel_digit_keys(tunes[i].channel, digits, operations)) < 0)
+			continue;
+		slots[i].first = events;
+		slots[i].events = panel_schedule(tunes[i].panel, operations, n,
+			!tunes[i].panel->press_only, &keys, entries + events,
+			requests + events);
+		events += slots[i].events;
+	}
+	if (events > 0 && avc1394_sequence_run(entries, events, AVC1394_POLL_TIMEOUT) >= 0) {
+		for (i = 0; i < count; i++) {
+			if (slots[i].events == 0)
+				continue;
+			last = 0;
+			for (j = slots[i].first; j < slots[i].first + slots[i].events; j++) {
+				if (entries[j].response != AVC1394_RESP_ACCEPTED)
+					break;
+				us = (entries[j].at.tv_sec - start.tv_sec) * 1000000L
+					+ (entries[j].at.tv_nsec - start.tv_nsec) / 1000
+					+ entries[j].skew + entries[j].latency;
+				if (us > last)
+					last = us;
+			}
+			if (j == slots[i].first + slots[i].events) {
+				tunes[i].result = 0;
+				tunes[i].latency = last / 1000;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (tunes[i].result != 0)
+			failed++;
+	free(slots);
+	free(entries);
+	free(requests);
+	return failed;
+}
@@ -0,0 +1,110 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * Originally written by Andreas Micklei <andreas.micklei@ivistar.de>
+ * Currently maintained by Dan Dennedy <dan@dennedy.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AVC1394_PANEL_H
+#define AVC1394_PANEL_H 1
+
+#include <libraw1394/raw1394.h>
+#include "avc1394.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Key timing, see avc1394_panel_calibrate() */
+#define AVC1394_PANEL_DEFAULT_GAP 100	/* ms from one key press to the next */
+#define AVC1394_PANEL_MIN_GAP 10
+#define AVC1394_PANEL_CALIBRATE_SAMPLES 3
+
+/* Longest key sequence sent at once */
+#define AVC1394_PANEL_MAX_KEYS 16
+
+/* A panel subunit, see avc1394_panel_init() */
+typedef struct avc1394_panel_struct {
+	raw1394handle_t	handle;
+	nodeid_t	node;
+	int		gap;		/* ms from one key press to the next */
+	int		hold;		/* ms from a press to its release */
+	int		press_only;	/* send digits without release events */
+	int		tune_function;	/* TUNE FUNCTION: 1 works, 0 not, -1 unknown */
+} avc1394_panel;
+
+/* Set up a panel with the default timing */
+void
+avc1394_panel_init(avc1394_panel *panel, raw1394handle_t handle, nodeid_t node);
+
+/* Time a few harmless pass-through inquiries and set the gap to twice the
+   slowest round-trip, so a key event is not sent before the device has
+   answered the previous one. Returns the new gap in ms, or -1 if the
+   device did not respond and the timing is unchanged. */
+int
+avc1394_panel_calibrate(avc1394_panel *panel);
+
+/* Build a PASS THROUGH control in host byte order. request must hold
+   2 + data_len / 4 quadlets. Returns the length in quadlets. */
+int
+avc1394_panel_build_pass_through(unsigned char operation, int release,
+	const unsigned char *data, int data_len, quadlet_t *request);
+
+/* Send a sequence of key operations, each a press followed by a release
+   unless release is 0, paced by the panel's gap. Returns the number of
+   key events the device did not accept, or -1 if nothing was sent. */
+int
+avc1394_panel_keys(avc1394_panel *panel, const unsigned char *operations,
+	int count, int release);
+
+/* Press and release one key */
+int
+avc1394_panel_key(avc1394_panel *panel, unsigned char operation);
+
+/* Enter a number on the keypad, zero padded to at least digits digits */
+int
+avc1394_panel_digits(avc1394_panel *panel, int number, int digits);
+
+/* Change to a channel with a single TUNE FUNCTION pass-through when the
+   device supports it, otherwise by entering it with avc1394_panel_digits().
+   Returns 0 if the device accepted the whole sequence, -1 otherwise. */
+int
+avc1394_panel_tune(avc1394_panel *panel, int channel, int digits);
+
+/* One device in a bulk channel change, see avc1394_panel_tune_all() */
+typedef struct avc1394_panel_tune_entry_struct {
+	avc1394_panel	*panel;
+	int		channel;
+	/* filled in by avc1394_panel_tune_all() */
+	int		result;		/* 0 or -1 */
+	long		latency;	/* ms until the last key was accepted */
+} avc1394_panel_tune_entry;
+
+/* Change channels on many devices at once, possibly on several ports, as
+   avc1394_panel_tune() does for one. All tune functions are sent before
+   any response is awaited, and the devices that need digits get them on a
+   shared time line, so the whole takes about as long as the slowest
+   device. Returns the number of devices that failed, or -1 if memory ran
+   out before anything was sent. */
+int
+avc1394_panel_tune_all(avc1394_panel_tune_entry *tunes, int count, int digits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
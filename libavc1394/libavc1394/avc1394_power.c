@@ -0,0 +1,205 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_power.c - switch units on and off, and wake many of them at
+ * once, reporting when each is actually ready for commands.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <time.h>
+#include <stdlib.h>
+
+#define UNIT (AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE)
+
+/* the POWER status operand */
+#define POWER_STATUS 0x7F
+
+/* status polls start this many ms apart and back off to the maximum */
+#define WAKE_BACKOFF_MIN 20
+#define WAKE_BACKOFF_MAX 1000
+/* longest sleep between looking for responses, ms */
+#define WAKE_TICK 5
+
+enum wake_state {
+	WAKE_COMMAND,		/* POWER ON outstanding */
+	WAKE_IDLE,		/* waiting for the next status poll */
+	WAKE_STATUS,		/* POWER status outstanding */
+	WAKE_READY
+};
+
+struct wake_slot {
+	avc1394_power_entry *entry;
+	avc1394_pending *pending;
+	enum wake_state state;
+	long due;		/* ms, when to poll next */
+	long backoff;
+};
+
+static long now_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000
+		+ (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static avc1394_pending *start_power(raw1394handle_t handle, nodeid_t node,
+	quadlet_t ctype, unsigned char operand)
+{
+	quadlet_t request[1];
+
+	request[0] = ctype | UNIT | AVC1394_COMMAND_POWER | operand;
+	return avc1394_transaction_start(handle, node, request, 1);
+}
+
+int avc1394_power(raw1394handle_t handle, nodeid_t node, int on)
+{
+	avc1394_pending *p;
+	int result;
+
+	p = start_power(handle, node, AVC1394_CTYPE_CONTROL,
+		on ? AVC1394_CMD_OPERAND_POWER_ON : AVC1394_CMD_OPERAND_POWER_OFF);
+	if (p == NULL)
+		return -1;
+	result = avc1394_transaction_wait(p);
+	avc1394_transaction_finish(p);
+	return result;
+}
+
+/* 1 if a finished POWER status says the unit is on */
+static int power_is_on(avc1394_pending *p)
+{
+	quadlet_t *response = avc1394_transaction_response(p, NULL);
+
+	return AVC1394_GET_RESPONSE(response[0]) == AVC1394_RESP_STABLE
+		&& (response[0] & 0xFF) == AVC1394_CMD_OPERAND_POWER_ON;
+}
+
+int avc1394_power_status(raw1394handle_t handle, nodeid_t node)
+{
+	avc1394_pending *p;
+	int result = -1;
+
+	p = start_power(handle, node, AVC1394_CTYPE_STATUS, POWER_STATUS);
+	if (p == NULL)
+		return -1;
+	if (avc1394_transaction_wait(p) == AVC1394_RESP_STABLE)
+		result = power_is_on(p);
+	avc1394_transaction_finish(p);
+	return result;
+}
+
+/* advance one unit's wake up by whatever has arrived; t is ms since start */
+static void wake_step(struct wake_slot *s, long t)
+{
+	avc1394_pending *p = s->pending;
+
+	if (p != NULL && avc1394_transaction_poll(p, 0)) {
+		if (s->state == WAKE_COMMAND) {
+			/* a unit that held the command until it was up is ready */
+			s->entry->result = AVC1394_GET_RESPONSE(
+				avc1394_transaction_response(p, NULL)[0]);
+			if (p->interim && s->entry->result == AVC1394_RESP_ACCEPTED)
+				s->state = WAKE_READY;
+			else
+				s->state = WAKE_IDLE;
+			s->due = t;
+		} else if (power_is_on(p)) {
+			s->state = WAKE_READY;
+		} else {
+			s->state = WAKE_IDLE;
+		}
+		avc1394_transaction_finish(p);
+		s->pending = NULL;
+	} else if (p != NULL && !p->interim
+			&& now_ms(&p->sent) > AVC1394_POLL_TIMEOUT) {
+		/* still booting, or the frame was lost; ask again later */
+		avc1394_transaction_finish(p);
+		s->pending = NULL;
+		s->state = WAKE_IDLE;
+	}
+
+	if (s->state == WAKE_READY) {
+		if (s->entry->ready < 0)
+			s->entry->ready = t;
+		return;
+	}
+	if (s->state == WAKE_IDLE && s->pending == NULL && t >= s->due) {
+		s->pending = start_power(s->entry->handle, s->entry->node,
+			AVC1394_CTYPE_STATUS, POWER_STATUS);
+		if (s->pending != NULL)
+			s->state = WAKE_STATUS;
+		s->due = t + s->backoff;
+		s->backoff *= 2;
+		if (s->backoff > WAKE_BACKOFF_MAX)
+			s->backoff = WAKE_BACKOFF_MAX;
+	}
+}
+
+int avc1394_power_wake(avc1394_power_entry *entries, int count, int timeout)
+{
+	struct wake_slot *slots;
+	struct timespec start, tick;
+	long t, next;
+	int i, waiting;
+
+	slots = calloc(count, sizeof(struct wake_slot));
+	if (slots == NULL)
+		return -1;
+
+	/* every unit gets its command before any is waited for */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+		slots[i].entry = &entries[i];
+		slots[i].backoff = WAKE_BACKOFF_MIN;
+		entries[i].result = -1;
+		entries[i].ready = -1;
+		slots[i].pending = start_power(entries[i].handle, entries[i].node,
+			AVC1394_CTYPE_CONTROL, AVC1394_CMD_OPERAND_POWER_ON);
+		slots[i].state = slots[i].pending != NULL ? WAKE_COMMAND : WAKE_IDLE;
+	}
+
+	for (;;) {
+		t = now_ms(&start);
+		next = t + WAKE_TICK;
+		waiting = 0;
+		for (i = 0; i < count; i++) {
+			wake_step(&slots[i], t);
+			if (slots[i].state == WAKE_READY)
+				continue;
+			waiting++;
+			if (slots[i].pending == NULL && slots[i].due < next)
+				next = slots[i].due;
+		}
+		if (waiting == 0 || t >= timeout)
+			break;
+		if (next > t) {
+			tick.tv_sec = 0;
+			tick.tv_nsec = (next - t) * 1000000L;
+			nanosleep(&tick, NULL);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (slots[i].pending != NULL)
+			avc1394_transaction_finish(slots[i].pending);
+	free(slots);
+	return waiting;
+}
@@ -0,0 +1,153 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_sequencer.c - dispatch AV/C commands to several devices at
+ * scheduled times, e.g. to roll, cue or record a group of decks together.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+/* wake up this many microseconds early and spin for the rest */
+#define SEQUENCE_SPIN_US 1000
+
+struct sequence_slot {
+	avc1394_sequence_entry *entry;
+	avc1394_pending *pending;
+};
+
+static long long ts_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000LL + ts->tv_nsec / 1000;
+}
+
+static int slot_compare(const void *a, const void *b)
+{
+	long long x = ts_us(&((const struct sequence_slot *) a)->entry->at);
+	long long y = ts_us(&((const struct sequence_slot *) b)->entry->at);
+
+	return x < y ? -1 : x > y;
+}
+
+static void wait_until(const struct timespec *at)
+{
+	struct timespec wake = *at, now;
+
+	wake.tv_nsec -= SEQUENCE_SPIN_US * 1000;
+	if (wake.tv_nsec < 0) {
+		wake.tv_sec--;
+		wake.tv_nsec += 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) != 0)
+		;
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (ts_us(&now) < ts_us(at));
+}
+
+void avc1394_sequence_time(struct timespec *at, long ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, at);
+	at->tv_sec += ms / 1000;
+	at->tv_nsec += (ms % 1000) * 1000000L;
+	if (at->tv_nsec >= 1000000000L) {
+		at->tv_sec++;
+		at->tv_nsec -= 1000000000L;
+	}
+}
+
+int avc1394_sequence_run(avc1394_sequence_entry *entries, int count, int timeout)
+{
+	struct sequence_slot *slots;
+	struct timespec now, deadline;
+	quadlet_t frame[AVC1394_FRAME_MAX / 4];
+	int i, n, failed = 0;
+
+	slots = calloc(count, sizeof(struct sequence_slot));
+	if (slots == NULL)
+		return -1;
+	for (i = 0; i < count; i++) {
+		slots[i].entry = &entries[i];
+		entries[i].response = -1;
+		entries[i].latency = -1;
+		entries[i].skew = 0;
+	}
+	qsort(slots, count, sizeof(struct sequence_slot), slot_compare);
+
+	/* set up every transaction in dispatch order, with its handle
+	   listening, so that dispatch is only the write */
+	for (i = 0; i < count; i++) {
+		avc1394_sequence_entry *e = slots[i].entry;
+
+		if (e->len < 1 || e->len > AVC1394_FRAME_MAX / 4)
+			continue;
+		memcpy(frame, e->request, e->len * sizeof(quadlet_t));
+		htonl_block(frame, e->len);
+		slots[i].pending = pending_open(e->handle, e->node, frame, e->len, 0);
+		if (slots[i].pending == NULL) {
+			failed = -1;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		avc1394_sequence_entry *e = slots[i].entry;
+		avc1394_pending *p = slots[i].pending;
+
+		if (p == NULL)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (ts_us(&now) < ts_us(&e->at))
+			wait_until(&e->at);
+		if (pending_send(p) < 0) {
+			avc1394_transaction_finish(p);
+			slots[i].pending = NULL;
+			continue;
+		}
+		e->skew = ts_us(&p->sent) - ts_us(&e->at);
+	}
+
+	/* collect the responses */
+	avc1394_sequence_time(&deadline, timeout);
+	for (i = 0; i < count; i++) {
+		avc1394_pending *p = slots[i].pending;
+
+		if (p == NULL) {
+			failed++;
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		n = (ts_us(&deadline) - ts_us(&now)) / 1000;
+		if (avc1394_transaction_poll(p, n > 0 ? n : 0)) {
+			slots[i].entry->response =
+				AVC1394_GET_RESPONSE(avc1394_transaction_response(p, NULL)[0]);
+			slots[i].entry->latency = avc1394_transaction_latency(p);
+		} else
+			failed++;
+	}
+out:
+	for (i = 0; i < count; i++)
+		if (slots[i].pending != NULL)
+			avc1394_transaction_finish(slots[i].pending);
+	free(slots);
+	return failed;
+}
@@ -59,6 +59,13 @@ int avc1394_send_command(raw1394handle_t handle, nodeid_t node, quadlet_t comman
 	return cooked1394_write(handle, 0xffc0 | node, FCP_COMMAND_ADDR, sizeof(quadlet_t), &cmd);
 }
 
+/* write a request already in network byte order, as the prebuilt frames are */
+int send_frame(raw1394handle_t handle, nodeid_t node, const quadlet_t *frame, int len)
+{
+	return cooked1394_write(handle, 0xffc0 | node, FCP_COMMAND_ADDR,
+	                        len * sizeof(quadlet_t), (quadlet_t *) frame);
+}
+
 int avc1394_send_command_block(raw1394handle_t handle, nodeid_t node,
                            quadlet_t *command, int command_len)
 {
@@ -75,11 +82,46 @@ int avc1394_send_command_block(raw1394handle_t handle, nodeid_t node,
 		fprintf(stderr, " 0x%08X", htonl(command[i]));
 	fprintf(stderr, " (%s)\n", decode_ctype(command[0]));
 #endif
-	return cooked1394_write(handle, 0xffc0 | node, FCP_COMMAND_ADDR,
-	                        command_len * sizeof(quadlet_t), cmd);
+	return send_frame(handle, node, cmd, command_len);
 }
 
 
+/*
+ * Wait up to AVC1394_POLL_TIMEOUT ms for a response to a blocking
+ * transaction. Responses taken by outstanding non-blocking transactions
+ * meanwhile do not count.
+ * RETURNS:	1 if fr holds a response, 0 if none came.
+ */
+static int wait_avc_response(raw1394handle_t handle, struct fcp_response *fr)
+{
+	struct pollfd raw1394_poll;
+	struct timespec deadline, now;
+	int timeout = AVC1394_POLL_TIMEOUT;
+
+	raw1394_poll.fd = raw1394_get_fd(handle);
+	raw1394_poll.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (fr->length == 0) {
+		if (poll(&raw1394_poll, 1, timeout) <= 0)
+			break;
+		if (raw1394_poll.revents & POLLIN)
+			raw1394_loop_iterate(handle);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout = (deadline.tv_sec - now.tv_sec) * 1000
+			+ (deadline.tv_nsec - now.tv_nsec) / 1000000;
+		if (timeout < 0)
+			break;
+	}
+	return fr->length != 0;
+}
+
 /*
  * Send an AV/C request to a device, wait for the corresponding AV/C
  * response and return that. This version only uses quadlet transactions.
@@ -94,9 +136,6 @@ quadlet_t avc1394_transaction(raw1394handle_t handle, nodeid_t node,
                           quadlet_t request, int retry)
 {
 	quadlet_t response = 0;
-	struct pollfd raw1394_poll;
-	raw1394_poll.fd = raw1394_get_fd(handle);
-	raw1394_poll.events = POLLIN;
 	struct fcp_response fr;
 
 	do {
@@ -114,16 +153,8 @@ quadlet_t avc1394_transaction(raw1394handle_t handle, nodeid_t node,
 		// Only poll if the receive handler hasn't been called yet.
 		// This can occur while waiting for command acknowledgement inside of
 		// raw1394_write.
-		if (fr.length==0) {
-			if ( poll( &raw1394_poll, 1, AVC1394_POLL_TIMEOUT) > 0 ) {
-				if (raw1394_poll.revents & POLLIN) {
-					raw1394_loop_iterate(handle);
-					response = ntohl(fr.data[0]);
-				}
-			}
-		} else {
+		if (wait_avc_response(handle, &fr))
 			response = ntohl(fr.data[0]);
-		}
 		if (response != 0) {
 			while (AVC1394_MASK_RESPONSE(response) == AVC1394_RESPONSE_INTERIM) {
 #ifdef DEBUG
@@ -132,12 +163,8 @@ quadlet_t avc1394_transaction(raw1394handle_t handle, nodeid_t node,
 				response = 0;
 				fr.length = 0;
 
-				if ( poll( &raw1394_poll, 1, AVC1394_POLL_TIMEOUT) > 0 ) {
-					if (raw1394_poll.revents & POLLIN) {
-						raw1394_loop_iterate(handle);
-						response = ntohl(fr.data[0]);
-					}
-				}
+				if (wait_avc_response(handle, &fr))
+					response = ntohl(fr.data[0]);
 			}
 		}
 		stop_avc_response_handler(handle);
@@ -175,9 +202,6 @@ quadlet_t *avc1394_transaction_block2(raw1394handle_t handle, nodeid_t node,
 		quadlet_t *request, int len, unsigned int *response_len, int retry)
 {
 	quadlet_t *response;
-	struct pollfd raw1394_poll;
-	raw1394_poll.fd = raw1394_get_fd(handle);
-	raw1394_poll.events = POLLIN;
 	struct fcp_response *fr = NULL;
 
 	*response_len = 0;
@@ -201,16 +225,7 @@ quadlet_t *avc1394_transaction_block2(raw1394handle_t handle, nodeid_t node,
 		// Only poll if the receive handler hasn't been called yet.
 		// This can occur while waiting for command acknowledgement inside of
 		// raw1394_write.
-		if (fr->length==0) {
-			if ( poll( &raw1394_poll, 1, AVC1394_POLL_TIMEOUT) > 0 ) {
-				if (raw1394_poll.revents & POLLIN) {
-					raw1394_loop_iterate(handle);
-					response = fr->data;
-					ntohl_block(response, fr->length);
-					*response_len = fr->length;
-				}
-			}
-		} else {
+		if (wait_avc_response(handle, fr)) {
 			response = fr->data;
 			ntohl_block(response, fr->length);
 			*response_len = fr->length;
@@ -224,13 +239,10 @@ quadlet_t *avc1394_transaction_block2(raw1394handle_t handle, nodeid_t node,
 				fr->length = 0;
 				*response_len = 0;
 
-				if ( poll( &raw1394_poll, 1, AVC1394_POLL_TIMEOUT) > 0 ) {
-					if (raw1394_poll.revents & POLLIN) {
-						raw1394_loop_iterate(handle);
-						response = fr->data;
-						ntohl_block(response, fr->length);
-						*response_len = fr->length;
-					}
+				if (wait_avc_response(handle, fr)) {
+					response = fr->data;
+					ntohl_block(response, fr->length);
+					*response_len = fr->length;
 				}
 			}
 		}
@@ -275,6 +287,228 @@ void avc1394_transaction_block_close(raw1394handle_t handle)
 }
 
 
+/*
+ * Non-blocking transactions. Each one is linked into a list kept for its
+ * handle, and pending_fcp_handler() hands every response to the
+ * oldest transaction waiting on the same node, subunit and opcode. That way several
+ * requests, even to different nodes, can be outstanding on one handle.
+ * A NOTIFY stays outstanding after its INTERIM response until the CHANGED
+ * one, and meanwhile does not take the responses meant for other commands.
+ */
+
+/* milliseconds left until the deadline */
+static int ms_until(struct timespec *deadline)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (deadline->tv_sec - now.tv_sec) * 1000
+		+ (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+/* frame is the request already in network byte order. Besides node,
+   subunit and opcode, a response has to echo the first match operands of
+   the request to be taken for it. The transaction is set up and the handle
+   listening, but nothing is sent until pending_send(). */
+avc1394_pending *pending_open(raw1394handle_t handle, nodeid_t node,
+		const quadlet_t *frame, int len, int match)
+{
+	avc1394_pending *p;
+	int only;
+
+	if (len < 1 || len * 4 > AVC1394_FRAME_MAX || 3 + match > len * 4)
+		return NULL;
+	p = calloc(1, sizeof(avc1394_pending));
+	if (p == NULL)
+		return NULL;
+	p->handle = handle;
+	p->node = node;
+	p->notify = AVC1394_MASK_CTYPE(ntohl(frame[0])) == AVC1394_CTYPE_NOTIFY;
+	memcpy(p->request, frame, len * 4);
+	p->request_len = len;
+	p->match = match;
+
+	if ((only = pending_link(p)) < 0) {
+		free(p);
+		return NULL;
+	}
+	/* take over the FCP handler; the others keep the handle listening */
+	if (raw1394_set_fcp_handler(handle, pending_fcp_handler) != pending_fcp_handler
+			|| only)
+		raw1394_start_fcp_listen(handle);
+	return p;
+}
+
+/* write the request of an opened transaction; returns 0 or -1 */
+int pending_send(avc1394_pending *pending)
+{
+	clock_gettime(CLOCK_MONOTONIC, &pending->sent);
+	pending->issued = 1;
+	return send_frame(pending->handle, pending->node,
+		(quadlet_t *) pending->request, pending->request_len);
+}
+
+avc1394_pending *pending_start_match(raw1394handle_t handle, nodeid_t node,
+		const quadlet_t *frame, int len, int match)
+{
+	avc1394_pending *p = pending_open(handle, node, frame, len, match);
+
+	if (p != NULL && pending_send(p) < 0) {
+		avc1394_transaction_finish(p);
+		return NULL;
+	}
+	return p;
+}
+
+avc1394_pending *pending_start_frame(raw1394handle_t handle, nodeid_t node,
+		const quadlet_t *frame, int len)
+{
+	return pending_start_match(handle, node, frame, len, 0);
+}
+
+avc1394_pending *avc1394_transaction_start(raw1394handle_t handle, nodeid_t node,
+		quadlet_t *request, int len)
+{
+	quadlet_t frame[AVC1394_FRAME_MAX / 4];
+
+	if (len < 1 || len > AVC1394_FRAME_MAX / 4)
+		return NULL;
+	memcpy(frame, request, len * sizeof(quadlet_t));
+	htonl_block(frame, len);
+	return pending_start_frame(handle, node, frame, len);
+}
+
+avc1394_pending *avc1394_transaction_start_frame(raw1394handle_t handle,
+		nodeid_t node, const avc1394_frame *request)
+{
+	quadlet_t frame[AVC1394_FRAME_MAX / 4];
+	int len = (request->length + 3) / 4;
+
+	/* the fields are public, so hold them to what avc1394_frame_init() takes */
+	if (request->length < 3 || request->length > AVC1394_FRAME_MAX)
+		return NULL;
+	frame[len - 1] = 0;
+	memcpy(frame, request->data, request->length);
+	return pending_start_frame(handle, node, frame, len);
+}
+
+/*
+ * Wait up to timeout milliseconds for the final response of a non-blocking
+ * transaction; 0 only processes what has already arrived.
+ * RETURNS:	1 if the final response has arrived, 0 if not yet.
+ */
+int avc1394_transaction_poll(avc1394_pending *pending, int timeout)
+{
+	struct pollfd raw1394_poll;
+	struct timespec deadline;
+
+	raw1394_poll.fd = raw1394_get_fd(pending->handle);
+	raw1394_poll.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (!pending->done) {
+		if (poll(&raw1394_poll, 1, timeout) <= 0)
+			break;
+		if (raw1394_poll.revents & POLLIN)
+			raw1394_loop_iterate(pending->handle);
+		if ((timeout = ms_until(&deadline)) < 0)
+			break;
+	}
+	return pending->done;
+}
+
+/*
+ * Block until the final response of a non-blocking transaction arrives,
+ * allowing extra time once the device has sent an INTERIM response.
+ * RETURNS:	the response code (one of AVC1394_RESP_...), or -1 if the
+ *		device did not respond.
+ */
+int avc1394_transaction_wait(avc1394_pending *pending)
+{
+	if (!avc1394_transaction_poll(pending, AVC1394_POLL_TIMEOUT)
+			&& !(pending->interim
+			     && avc1394_transaction_poll(pending, AVC1394_INTERIM_TIMEOUT)))
+		return -1;
+	return pending->received[0] & 0x0F;
+}
+
+/*
+ * RETURNS:	the final response in host byte order, or NULL if it has not
+ *		arrived. The buffer belongs to the transaction.
+ */
+quadlet_t *avc1394_transaction_response(avc1394_pending *pending,
+		unsigned int *response_len)
+{
+	if (pending->done && !pending->converted) {
+		/* zero the padding of the last quadlet */
+		pending->fr.length = (pending->received_length + 3) / 4;
+		pending->fr.data[pending->fr.length - 1] = 0;
+		memcpy(pending->fr.data, pending->received, pending->received_length);
+		ntohl_block(pending->fr.data, pending->fr.length);
+		pending->converted = 1;
+	}
+	if (response_len != NULL)
+		*response_len = pending->done ? pending->fr.length : 0;
+	return pending->done ? pending->fr.data : NULL;
+}
+
+int avc1394_transaction_frame(avc1394_pending *pending, avc1394_frame *frame)
+{
+	if (!pending->done)
+		return -1;
+	return avc1394_frame_init(frame, pending->received,
+		pending->received_length, pending->received_length);
+}
+
+/*
+ * Send a request of header and operand bytes and wait for its final
+ * response.
+ * RETURNS:	the transaction holding the response, to be finished by the
+ *		caller, or NULL if the request was too long or unanswered.
+ */
+avc1394_pending *pending_command(raw1394handle_t handle, nodeid_t node,
+		quadlet_t header, unsigned char *operands, int len)
+{
+	quadlet_t request[(len + 6) / 4];
+	avc1394_pending *p;
+
+	len = pack_request(request, header, operands, len);
+	if (len * 4 > MAX_RESPONSE_SIZE)
+		return NULL;
+	p = avc1394_transaction_start(handle, node, request, len);
+	if (p != NULL && avc1394_transaction_wait(p) < 0) {
+		avc1394_transaction_finish(p);
+		return NULL;
+	}
+	return p;
+}
+
+/*
+ * RETURNS:	microseconds from sending the request to its final response,
+ *		or -1 if it has not arrived.
+ */
+long avc1394_transaction_latency(avc1394_pending *pending)
+{
+	if (!pending->done)
+		return -1;
+	return (pending->answered.tv_sec - pending->sent.tv_sec) * 1000000L
+		+ (pending->answered.tv_nsec - pending->sent.tv_nsec) / 1000;
+}
+
+void avc1394_transaction_finish(avc1394_pending *pending)
+{
+	if (pending_unlink(pending))
+		raw1394_stop_fcp_listen(pending->handle);
+	free(pending);
+}
+
+
 /*---------------------
  * HIGH-LEVEL-FUNCTIONS
  * --------------------
@@ -282,14 +516,19 @@ void avc1394_transaction_block_close(raw1394handle_t handle)
 
 /*
  * Open an AV/C descriptor
+ * RETURNS:	0, or -1 if the device did not respond or did not accept a
+ *		control.
  */
 int avc1394_open_descriptor(raw1394handle_t handle, nodeid_t node,
                         quadlet_t ctype, quadlet_t subunit,
                         unsigned char *descriptor_identifier, int len_descriptor_identifier,
                         unsigned char readwrite)
 {
-	quadlet_t  request[2];
+	quadlet_t  request[(len_descriptor_identifier + 10) / 4];
 	quadlet_t *response;
+	unsigned char operands[len_descriptor_identifier + 4];
+	int len = len_descriptor_identifier;
+	int result;
 	unsigned char subfunction = readwrite?
 		AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_WRITE_OPEN
 		:AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_READ_OPEN;
@@ -304,19 +543,20 @@ int avc1394_open_descriptor(raw1394handle_t handle, nodeid_t node,
 	}
 #endif
 
-	if (len_descriptor_identifier != 1)
-		fprintf(stderr, "Unimplemented.\n");
-	/*request[0] = ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR
-		| ((*descriptor_identifier & 0xFF00) >> 16);
-	request[1] = ((*descriptor_identifier & 0xFF) << 24) | subfunction;*/
-
-	request[0] = ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR
-				| *descriptor_identifier;
-	request[1] = subfunction << 24;
-	if (ctype == AVC1394_CTYPE_STATUS)
-		request[1] = 0xFF00FFFF;
+	/* descriptor_specifier, subfunction, reserved */
+	memcpy(operands, descriptor_identifier, len);
+	operands[len++] = subfunction;
+	operands[len++] = 0x00;
+	if (ctype == AVC1394_CTYPE_STATUS) {
+		/* status, reserved, node_ID */
+		operands[len - 2] = 0xFF;
+		operands[len++] = 0xFF;
+		operands[len++] = 0xFF;
+	}
+	len = pack_request(request, ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR,
+		operands, len);
 
-	response = avc1394_transaction_block(handle, node, request, 2, AVC1394_RETRY);
+	response = avc1394_transaction_block(handle, node, request, len, AVC1394_RETRY);
 	if (response == NULL) {
 		avc1394_transaction_block_close(handle);
 		return -1;
@@ -326,8 +566,10 @@ int avc1394_open_descriptor(raw1394handle_t handle, nodeid_t node,
 	fprintf(stderr, "Open descriptor response: 0x%08X.\n", *response);
 #endif
 
+	result = (ctype == AVC1394_CTYPE_CONTROL
+		&& AVC1394_MASK_RESPONSE(*response) != AVC1394_RESPONSE_ACCEPTED) ? -1 : 0;
 	avc1394_transaction_block_close(handle);
-	return 0;
+	return result;
 }
 
 /*
@@ -337,9 +579,10 @@ int avc1394_close_descriptor(raw1394handle_t handle, nodeid_t node,
                          quadlet_t ctype, quadlet_t subunit,
                          unsigned char *descriptor_identifier, int len_descriptor_identifier)
 {
-	quadlet_t  request[2];
+	quadlet_t  request[(len_descriptor_identifier + 8) / 4];
 	quadlet_t *response;
-	unsigned char subfunction = AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_CLOSE;
+	unsigned char operands[len_descriptor_identifier + 2];
+	int len = len_descriptor_identifier;
 
 #ifdef DEBUG
 	{
@@ -350,17 +593,15 @@ int avc1394_close_descriptor(raw1394handle_t handle, nodeid_t node,
 		fprintf(stderr,"\n");
 	}
 #endif
-	if (len_descriptor_identifier != 1)
-		fprintf(stderr, "Unimplemented.\n");
-	/*request[0] = ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR
-		| ((*descriptor_identifier & 0xFF00) >> 16);
-	request[1] = ((*descriptor_identifier & 0xFF) << 24) | subfunction;*/
 
-	request[0] = ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR
-	             | *descriptor_identifier;
-	request[1] = subfunction << 24;
+	/* closing is an OPEN DESCRIPTOR with the close subfunction */
+	memcpy(operands, descriptor_identifier, len);
+	operands[len++] = AVC1394_OPERAND_DESCRIPTOR_SUBFUNCTION_CLOSE;
+	operands[len++] = 0x00;
+	len = pack_request(request, ctype | subunit | AVC1394_COMMAND_OPEN_DESCRIPTOR,
+		operands, len);
 
-	response = avc1394_transaction_block(handle, node, request, 2, AVC1394_RETRY);
+	response = avc1394_transaction_block(handle, node, request, len, AVC1394_RETRY);
 	if (response == NULL) {
 		avc1394_transaction_block_close(handle);
 		return -1;
@@ -375,7 +616,8 @@ int avc1394_close_descriptor(raw1394handle_t handle, nodeid_t node,
 }
 
 /*
- * Read an entire AV/C descriptor
+ * Read an AV/C descriptor in a single transaction, as far as it fits in
+ * one response. See avc1394_descriptor_read() for descriptors of any size.
  *
  * IMPORTANT:
  *   Caller must call avc1394_transaction_block_close() when finished with 
@@ -385,19 +627,21 @@ unsigned char *avc1394_read_descriptor(raw1394handle_t handle, nodeid_t node,
                                    quadlet_t subunit,
                                    unsigned char *descriptor_identifier, int len_descriptor_identifier)
 {
-	quadlet_t  request[128];
+	quadlet_t  request[(len_descriptor_identifier + 12) / 4];
 	quadlet_t *response;
+	unsigned char operands[len_descriptor_identifier + 6];
+	int len = len_descriptor_identifier;
 	
-	if (len_descriptor_identifier != 1)
-		fprintf(stderr, "Unimplemented.\n");
+	/* read_result_status, reserved, data_length 0 (entire descriptor),
+	   address 0 */
+	memcpy(operands, descriptor_identifier, len);
+	memset(operands + len, 0, 6);
+	operands[len] = 0xFF;
+	len = pack_request(request,
+		AVC1394_CTYPE_CONTROL | subunit | AVC1394_COMMAND_READ_DESCRIPTOR,
+		operands, len + 6);
 	
-	memset(request, 0, 128*4);
-	request[0] = AVC1394_CTYPE_CONTROL | subunit | AVC1394_COMMAND_READ_DESCRIPTOR
-	             | *descriptor_identifier;
-	request[1] = 0xFF000000;	/* read entire descriptor */
-	request[2] = 0x00000000;	/* beginning from 0x0000 */
-	
-	response = avc1394_transaction_block(handle, node, request, 3, AVC1394_RETRY);
+	response = avc1394_transaction_block(handle, node, request, len, AVC1394_RETRY);
 	if (response == NULL)
 		return NULL;
 	
@@ -488,58 +732,73 @@ quadlet_t *avc1394_unit_info(raw1394handle_t handle, nodeid_t node)
 /*************** TARGET *******************************************************/
 
 avc1394_command_handler_t g_command_handler = NULL;
+avc1394_frame_handler_t g_frame_handler = NULL;
+
+#ifdef DEBUG
+static void dump_frame(const char *direction, const avc1394_frame *frame)
+{
+	unsigned int i;
+
+	fprintf(stderr, "%s ", direction);
+	for (i = 0; i < frame->length; i++)
+		fprintf(stderr, "%02x%s", frame->data[i], i % 4 == 3 ? " " : "");
+	fprintf(stderr, "(length %u)\n", frame->length);
+}
+#endif
+
+/* hand a command to the classic handler, if it fits its structure */
+static int command_handler_frame(const avc1394_frame *request,
+	avc1394_frame *response)
+{
+	struct avc1394_command_response cmd_resp;
+
+	if (request->length > sizeof(cmd_resp))
+		return 0;
+	memset(&cmd_resp, 0, sizeof(cmd_resp));
+	memcpy(&cmd_resp, request->data, request->length);
+	if (g_command_handler(&cmd_resp) == 0)
+		return 0;
+	memcpy(response->data, &cmd_resp, request->length);
+	return 1;
+}
 
 int target_fcp_handler( raw1394handle_t handle, nodeid_t nodeid, int response, 
 	size_t length, unsigned char *data )
 {
+	quadlet_t buffer[AVC1394_FRAME_MAX / 4];
+	avc1394_frame request, reply;
 	int result;
-	struct avc1394_command_response cmd_resp;
-	quadlet_t *r = (quadlet_t *) &cmd_resp;
-	
-	/* initialize the response from the request */
-	memset(&cmd_resp, 0, sizeof(cmd_resp));
-	memcpy(r, data, length);
 
-	if ( response != 0 )
-	{
+	/* the command is only read where it was received */
+	if (response != 0
+			|| avc1394_frame_init(&request, data, length, length) < 0)
 		return 0;
-	}
-	else
-	{
+	memcpy(buffer, data, length);
+	avc1394_frame_init(&reply, (unsigned char *) buffer, length, sizeof(buffer));
 #ifdef DEBUG
-		{
-		int q, z;
-		z = (length % 4) ? length + (4 - (length % 4)) : length;
-		printf("----> ");
-		for (q = 0; q < z / 4; q++)
-		    printf("%08x ", r[q]);
-		printf("(length %d)\n", length);
-		printf("----> type=0x%02x subunit_type=0x%x subunit_id=0x%x opcode=0x%x operand0=0x%x\n",
-			cmd_resp.status, cmd_resp.subunit_type,
-			cmd_resp.subunit_id, cmd_resp.opcode, cmd_resp.operand[0]);
-	    }
+	dump_frame("---->", &request);
 #endif
-		result = g_command_handler( &cmd_resp );
-		
-		if (result == 0) 
-			cmd_resp.status = AVC1394_RESP_NOT_IMPLEMENTED;
-		
+
+	/* vendor handlers get their commands before the general handler */
+	result = vendor_dispatch(nodeid, &request, &reply);
+	if (result < 0 && g_frame_handler != NULL)
+		result = g_frame_handler(nodeid, &request, &reply);
+	else if (result < 0)
+		result = command_handler_frame(&request, &reply);
+	if (result == 0) {
+		memcpy(buffer, data, length);
+		reply.length = length;
+		avc1394_frame_set_ctype(&reply, AVC1394_RESP_NOT_IMPLEMENTED);
+	}
 #ifdef DEBUG
-		{
-		int q, z;
-		z = (length % 4) ? length + (4 - (length % 4)) : length;
-		printf("<---- ");
-		for (q = 0; q < z / 4; q++)
-		    printf("%08x ", r[q]);
-		printf("(length %d)\n", length);
-		printf("<---- type=0x%02x subunit_type=0x%x subunit_id=0x%x opcode=0x%x operand0=0x%x\n",
-			cmd_resp.status, cmd_resp.subunit_type,
-			cmd_resp.subunit_id, cmd_resp.opcode, cmd_resp.operand[0]);
-	    }
+	dump_frame("<----", &reply);
 #endif
-		
-		return cooked1394_write(handle, 0xffc0 | nodeid, FCP_RESPONSE_ADDR, length, r);
-	}
+
+	/* FCP frames are whole quadlets */
+	while (reply.length % 4)
+		reply.data[reply.length++] = 0;
+	return cooked1394_write(handle, 0xffc0 | nodeid, FCP_RESPONSE_ADDR,
+		reply.length, buffer);
 }
 
 
@@ -549,12 +808,25 @@ avc1394_init_target( raw1394handle_t handle, avc1394_command_handler_t cmd_handl
 	if (cmd_handler == NULL)
 		return -1;
 	g_command_handler = cmd_handler;
+	g_frame_handler = NULL;
 	if (raw1394_set_fcp_handler( handle, target_fcp_handler ) < 0)
 		return -1;
 	return raw1394_start_fcp_listen( handle );
 }
 
 
+int
+avc1394_init_target_frames(raw1394handle_t handle, avc1394_frame_handler_t handler)
+{
+	if (handler == NULL)
+		return -1;
+	g_frame_handler = handler;
+	if (raw1394_set_fcp_handler(handle, target_fcp_handler) < 0)
+		return -1;
+	return raw1394_start_fcp_listen(handle);
+}
+
+
 int
 avc1394_close_target( raw1394handle_t handle )
 {
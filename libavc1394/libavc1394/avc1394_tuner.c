@@ -0,0 +1,277 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_tuner.c - tune a tuner subunit to a service with a single
+ * command, and keep its status until it changes.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * The commands all start with the tuner output plug and a status byte that
+ * is 0xFF in commands. A service is its AVC1394_TUNER_SERVICE_... type and
+ * then the 16 bit network, stream and service IDs, or the major and minor
+ * channel numbers.
+ *
+ * DIRECT SELECT INFORMATION TYPE:	plug, status, 1 service, service
+ * CA ENABLE:				plug, status, enable, service
+ * TUNER STATUS:			plug, flags, signal, service
+ */
+#define TUNER_STATUS_SEARCHING 0x80
+#define TUNER_STATUS_LOCKED 0x40
+#define TUNER_STATUS_CA 0x20
+#define TUNER_CA_ENABLE 0x80
+
+/* the longest service */
+#define SERVICE_MAX 7
+
+#define TUNER(id) (AVC1394_SUBUNIT_TYPE_TUNER | (id))
+#define OPCODE(op) ((op) << 8)
+
+static int pack_service(unsigned char *operands, const avc1394_tuner_service *service)
+{
+	operands[0] = service->type;
+	switch (service->type) {
+	case AVC1394_TUNER_SERVICE_ID:
+		operands[1] = service->network_id >> 8;
+		operands[2] = service->network_id;
+		operands[3] = service->stream_id >> 8;
+		operands[4] = service->stream_id;
+		operands[5] = service->service_id >> 8;
+		operands[6] = service->service_id;
+		return 7;
+	case AVC1394_TUNER_SERVICE_CHANNEL:
+		operands[1] = service->major >> 8;
+		operands[2] = service->major;
+		operands[3] = service->minor >> 8;
+		operands[4] = service->minor;
+		return 5;
+	}
+	return -1;
+}
+
+/* the service at operand offset of frame; returns -1 if there is none */
+static int unpack_service(const avc1394_frame *frame, int offset,
+	avc1394_tuner_service *service)
+{
+	unsigned char *o;
+
+	memset(service, 0, sizeof(avc1394_tuner_service));
+	service->type = avc1394_frame_operand(frame, offset);
+	switch (service->type) {
+	case AVC1394_TUNER_SERVICE_ID:
+		if ((o = avc1394_frame_operands(frame, offset + 1, 6)) == NULL)
+			return -1;
+		service->network_id = (o[0] << 8) | o[1];
+		service->stream_id = (o[2] << 8) | o[3];
+		service->service_id = (o[4] << 8) | o[5];
+		return 0;
+	case AVC1394_TUNER_SERVICE_CHANNEL:
+		if ((o = avc1394_frame_operands(frame, offset + 1, 4)) == NULL)
+			return -1;
+		service->major = (o[0] << 8) | o[1];
+		service->minor = (o[2] << 8) | o[3];
+		return 0;
+	}
+	return -1;
+}
+
+static int same_service(const avc1394_tuner_service *a, const avc1394_tuner_service *b)
+{
+	if (a->type != b->type)
+		return 0;
+	if (a->type == AVC1394_TUNER_SERVICE_ID)
+		return a->network_id == b->network_id && a->stream_id == b->stream_id
+			&& a->service_id == b->service_id;
+	return a->major == b->major && a->minor == b->minor;
+}
+
+/* send a command naming service after the first two operands */
+static int service_command(raw1394handle_t handle, nodeid_t node,
+	quadlet_t header, int plug, unsigned char third,
+	const avc1394_tuner_service *service)
+{
+	unsigned char operands[3 + SERVICE_MAX];
+	avc1394_frame frame;
+	avc1394_pending *p;
+	int len, code;
+
+	operands[0] = plug;
+	operands[1] = 0xFF;
+	operands[2] = third;
+	if ((len = pack_service(operands + 3, service)) < 0)
+		return -1;
+	p = pending_command(handle, node, header, operands, 3 + len);
+	if (p == NULL)
+		return -1;
+	code = avc1394_transaction_frame(p, &frame) < 0 ? -1
+		: avc1394_frame_ctype(&frame);
+	avc1394_transaction_finish(p);
+	return code;
+}
+
+int avc1394_tuner_direct_select(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, const avc1394_tuner_service *service)
+{
+	return service_command(handle, node, AVC1394_CTYPE_CONTROL | TUNER(tuner)
+		| OPCODE(AVC1394_TUNER_COMMAND_DIRECT_SELECT_INFORMATION_TYPE),
+		plug, 1, service);
+}
+
+int avc1394_tuner_ca_enable(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, const avc1394_tuner_service *service, int enable)
+{
+	return service_command(handle, node, AVC1394_CTYPE_CONTROL | TUNER(tuner)
+		| OPCODE(AVC1394_TUNER_COMMAND_CA_ENABLE),
+		plug, enable ? TUNER_CA_ENABLE : 0, service);
+}
+
+static void status_request(unsigned char *operands, int plug)
+{
+	operands[0] = plug;
+	operands[1] = 0xFF;
+	operands[2] = 0xFF;
+	operands[3] = 0xFF;
+}
+
+static int parse_status(const avc1394_frame *frame, avc1394_tuner_status *status)
+{
+	int flags = avc1394_frame_operand(frame, 1);
+	int signal = avc1394_frame_operand(frame, 2);
+
+	if (avc1394_frame_ctype(frame) != AVC1394_RESP_STABLE || signal < 0)
+		return -1;
+	status->searching = (flags & TUNER_STATUS_SEARCHING) != 0;
+	status->locked = (flags & TUNER_STATUS_LOCKED) != 0;
+	status->ca_enabled = (flags & TUNER_STATUS_CA) != 0;
+	status->signal = signal;
+	/* nothing selected yet leaves the service type 0 */
+	if (unpack_service(frame, 3, &status->service) < 0)
+		memset(&status->service, 0, sizeof(avc1394_tuner_service));
+	return 0;
+}
+
+int avc1394_tuner_get_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, avc1394_tuner_status *status)
+{
+	unsigned char operands[4];
+	avc1394_frame frame;
+	avc1394_pending *p;
+	int result = -1;
+
+	status_request(operands, plug);
+	p = pending_command(handle, node, AVC1394_CTYPE_STATUS | TUNER(tuner)
+		| OPCODE(AVC1394_TUNER_COMMAND_AVC1394_TUNER_STATUS), operands, 4);
+	if (p == NULL)
+		return -1;
+	if (avc1394_transaction_frame(p, &frame) == 0)
+		result = parse_status(&frame, status);
+	avc1394_transaction_finish(p);
+	return result;
+}
+
+
+struct avc1394_tuner_struct {
+	raw1394handle_t handle;
+	nodeid_t node;
+	quadlet_t tuner;
+	int plug;
+	int watch;
+	avc1394_tuner_status status;
+	struct watched watched;
+};
+
+avc1394_tuner *avc1394_tuner_new(raw1394handle_t handle, nodeid_t node,
+	quadlet_t tuner, int plug, int watch)
+{
+	avc1394_tuner *t = calloc(1, sizeof(avc1394_tuner));
+
+	if (t == NULL)
+		return NULL;
+	t->handle = handle;
+	t->node = node;
+	t->tuner = tuner;
+	t->plug = plug;
+	t->watch = watch;
+	return t;
+}
+
+void avc1394_tuner_flush(avc1394_tuner *tuner)
+{
+	watch_stop(&tuner->watched);
+}
+
+void avc1394_tuner_free(avc1394_tuner *tuner)
+{
+	avc1394_tuner_flush(tuner);
+	free(tuner);
+}
+
+static int tuner_load(avc1394_tuner *tuner)
+{
+	unsigned char operands[4];
+	quadlet_t request[2];
+	int len;
+
+	watch_start(&tuner->watched, tuner->handle);
+	if (avc1394_tuner_get_status(tuner->handle, tuner->node, tuner->tuner,
+			tuner->plug, &tuner->status) < 0)
+		return -1;
+	tuner->watched.valid = 1;
+
+	if (tuner->watch) {
+		status_request(operands, tuner->plug);
+		len = pack_request(request, AVC1394_CTYPE_NOTIFY | TUNER(tuner->tuner)
+			| OPCODE(AVC1394_TUNER_COMMAND_AVC1394_TUNER_STATUS), operands, 4);
+		/* only for this output plug */
+		htonl_block(request, len);
+		watch_arm(&tuner->watched, tuner->node, request, len, 1);
+	}
+	return 0;
+}
+
+int avc1394_tuner_read_status(avc1394_tuner *tuner, avc1394_tuner_status *status)
+{
+	if (!watch_check(&tuner->watched) && tuner_load(tuner) < 0)
+		return -1;
+	*status = tuner->status;
+	return 0;
+}
+
+int avc1394_tuner_select(avc1394_tuner *tuner, const avc1394_tuner_service *service)
+{
+	int result;
+
+	if (watch_check(&tuner->watched)
+			&& same_service(&tuner->status.service, service))
+		return AVC1394_RESP_ACCEPTED;
+	result = avc1394_tuner_direct_select(tuner->handle, tuner->node,
+		tuner->tuner, tuner->plug, service);
+	if (result != AVC1394_RESP_ACCEPTED || !watch_check(&tuner->watched))
+		return result;
+
+	/* lock and signal of the new service only come with the NOTIFY */
+	if (tuner->watch)
+		tuner->status.service = *service;
+	else
+		avc1394_tuner_flush(tuner);
+	return result;
+}
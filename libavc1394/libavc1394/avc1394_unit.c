@@ -0,0 +1,362 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_unit.c - unit plug and connection management: PLUG INFO,
+ * CONNECT, DISCONNECT, CONNECTIONS, CONNECT AV, CHANNEL USAGE, plug signal
+ * formats and DIGITAL INPUT/OUTPUT. Keep a device's plugs and connections
+ * in a graph that is refreshed on bus reset or when the device notifies a
+ * change.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define UNIT (AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE)
+
+/* bytes of one connection in CONNECT, DISCONNECT and CONNECTIONS */
+#define CONNECTION_OPERANDS 5
+
+/* send a command and copy len operand bytes of an accepted or stable
+   response; returns the response code or -1 */
+static int unit_command(raw1394handle_t handle, nodeid_t node, quadlet_t header,
+	unsigned char *operands, int len, unsigned char *result, int result_len)
+{
+	avc1394_pending *p;
+	quadlet_t *response;
+	unsigned int response_len;
+	int code;
+
+	p = pending_command(handle, node, header, operands, len);
+	if (p == NULL)
+		return -1;
+	response = avc1394_transaction_response(p, &response_len);
+	code = AVC1394_GET_RESPONSE(response[0]);
+	if ((code == AVC1394_RESP_ACCEPTED || code == AVC1394_RESP_STABLE)
+			&& result_len > 0
+			&& unpack_response(response, response_len, 0, result, result_len)
+				< result_len)
+		code = -1;
+	avc1394_transaction_finish(p);
+	return code;
+}
+
+static void pack_connection(unsigned char *operands, const avc1394_connection *c)
+{
+	operands[1] = c->source_subunit;
+	operands[2] = c->source_plug;
+	operands[3] = c->destination_subunit;
+	operands[4] = c->destination_plug;
+}
+
+static void unpack_connection(const unsigned char *operands, avc1394_connection *c)
+{
+	c->lock = (operands[0] >> 1) & 1;
+	c->perm = operands[0] & 1;
+	c->source_subunit = operands[1];
+	c->source_plug = operands[2];
+	c->destination_subunit = operands[3];
+	c->destination_plug = operands[4];
+}
+
+int avc1394_plug_info(raw1394handle_t handle, nodeid_t node, quadlet_t subunit,
+	avc1394_plugs *info)
+{
+	unsigned char operands[5] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	if (unit_command(handle, node,
+			AVC1394_CTYPE_STATUS | subunit | AVC1394_COMMAND_PLUG_INFO,
+			operands, 5, operands, 5) != AVC1394_RESP_STABLE)
+		return -1;
+	info->iso_inputs = operands[1];
+	info->iso_outputs = operands[2];
+	info->external_inputs = operands[3];
+	info->external_outputs = operands[4];
+	return 0;
+}
+
+int avc1394_connect(raw1394handle_t handle, nodeid_t node,
+	const avc1394_connection *connection)
+{
+	unsigned char operands[CONNECTION_OPERANDS];
+
+	operands[0] = 0xFC | (connection->lock ? 2 : 0) | (connection->perm ? 1 : 0);
+	pack_connection(operands, connection);
+	return unit_command(handle, node,
+		AVC1394_CTYPE_CONTROL | UNIT | AVC1394_COMMAND_CONNECT,
+		operands, CONNECTION_OPERANDS, NULL, 0);
+}
+
+int avc1394_disconnect(raw1394handle_t handle, nodeid_t node,
+	const avc1394_connection *connection)
+{
+	unsigned char operands[CONNECTION_OPERANDS];
+
+	operands[0] = 0xFF;
+	pack_connection(operands, connection);
+	return unit_command(handle, node,
+		AVC1394_CTYPE_CONTROL | UNIT | AVC1394_COMMAND_DISCONNECT,
+		operands, CONNECTION_OPERANDS, NULL, 0);
+}
+
+int avc1394_connections(raw1394handle_t handle, nodeid_t node,
+	avc1394_connection *connections, int max)
+{
+	unsigned char operands[MAX_RESPONSE_SIZE] = { 0xFF };
+	avc1394_pending *p;
+	quadlet_t *response;
+	unsigned int response_len;
+	int i, count = -1;
+
+	p = pending_command(handle, node,
+		AVC1394_CTYPE_STATUS | UNIT | AVC1394_COMMAND_CONNECTIONS,
+		operands, 1);
+	if (p == NULL)
+		return -1;
+	response = avc1394_transaction_response(p, &response_len);
+	if (AVC1394_GET_RESPONSE(response[0]) == AVC1394_RESP_STABLE
+			&& unpack_response(response, response_len, 0, operands, 1) == 1) {
+		/* total_connections, then the connections themselves */
+		count = operands[0];
+		if (count > max)
+			count = max;
+		if (unpack_response(response, response_len, 1, operands,
+				count * CONNECTION_OPERANDS) < count * CONNECTION_OPERANDS)
+			count = -1;
+		for (i = 0; i < count; i++)
+			unpack_connection(operands + i * CONNECTION_OPERANDS, &connections[i]);
+	}
+	avc1394_transaction_finish(p);
+	return count;
+}
+
+static int av_command(raw1394handle_t handle, nodeid_t node, quadlet_t opcode,
+	const avc1394_av_connection *c)
+{
+	unsigned char operands[5];
+
+	operands[0] = c->types;
+	operands[1] = c->audio_source;
+	operands[2] = c->video_source;
+	operands[3] = c->audio_destination;
+	operands[4] = c->video_destination;
+	return unit_command(handle, node, AVC1394_CTYPE_CONTROL | UNIT | opcode,
+		operands, 5, NULL, 0);
+}
+
+int avc1394_connect_av(raw1394handle_t handle, nodeid_t node,
+	const avc1394_av_connection *connection)
+{
+	return av_command(handle, node, AVC1394_COMMAND_CONNECT_AV, connection);
+}
+
+int avc1394_disconnect_av(raw1394handle_t handle, nodeid_t node,
+	const avc1394_av_connection *connection)
+{
+	return av_command(handle, node, AVC1394_COMMAND_DISCONNECT_AV, connection);
+}
+
+int avc1394_channel_usage(raw1394handle_t handle, nodeid_t node, int channel,
+	nodeid_t *user, int *plug)
+{
+	unsigned char operands[4] = { channel, 0xFF, 0xFF, 0xFF };
+
+	if (unit_command(handle, node,
+			AVC1394_CTYPE_STATUS | UNIT | AVC1394_COMMAND_CHANNEL_USAGE,
+			operands, 4, operands, 4) != AVC1394_RESP_STABLE)
+		return -1;
+	if (operands[1] == 0xFF && operands[2] == 0xFF)
+		return 0;
+	if (user != NULL)
+		*user = (operands[1] << 8) | operands[2];
+	if (plug != NULL)
+		*plug = operands[3];
+	return 1;
+}
+
+int avc1394_get_plug_signal_format(raw1394handle_t handle, nodeid_t node,
+	int output, int plug, quadlet_t *format)
+{
+	unsigned char operands[5] = { plug, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	if (unit_command(handle, node, AVC1394_CTYPE_STATUS | UNIT
+			| (output ? AVC1394_COMMAND_OUTPUT_PLUG_SIGNAL_FORMAT
+				: AVC1394_COMMAND_INPUT_PLUG_SIGNAL_FORMAT),
+			operands, 5, operands, 5) != AVC1394_RESP_STABLE)
+		return -1;
+	*format = (operands[1] << 24) | (operands[2] << 16)
+		| (operands[3] << 8) | operands[4];
+	return 0;
+}
+
+int avc1394_set_plug_signal_format(raw1394handle_t handle, nodeid_t node,
+	int output, int plug, quadlet_t format)
+{
+	unsigned char operands[5];
+
+	operands[0] = plug;
+	operands[1] = format >> 24;
+	operands[2] = format >> 16;
+	operands[3] = format >> 8;
+	operands[4] = format;
+	return unit_command(handle, node, AVC1394_CTYPE_CONTROL | UNIT
+		| (output ? AVC1394_COMMAND_OUTPUT_PLUG_SIGNAL_FORMAT
+			: AVC1394_COMMAND_INPUT_PLUG_SIGNAL_FORMAT),
+		operands, 5, NULL, 0);
+}
+
+int avc1394_digital_connection(raw1394handle_t handle, nodeid_t node,
+	int output, unsigned char state)
+{
+	quadlet_t opcode = output ? AVC1394_COMMAND_DIGITAL_OUTPUT
+		: AVC1394_COMMAND_DIGITAL_INPUT;
+	unsigned char operands[1] = { state };
+	int code;
+
+	if (state != AVC1394_OPERAND_DIGITAL_STATUS)
+		return unit_command(handle, node, AVC1394_CTYPE_CONTROL | UNIT | opcode,
+			operands, 1, NULL, 0);
+	code = unit_command(handle, node, AVC1394_CTYPE_STATUS | UNIT | opcode,
+		operands, 1, operands, 1);
+	return code == AVC1394_RESP_STABLE ? operands[0] : -1;
+}
+
+
+struct avc1394_plug_graph_struct {
+	raw1394handle_t handle;
+	nodeid_t node;
+	int watch;
+	avc1394_plugs plugs;
+	int count;
+	avc1394_connection connections[AVC1394_CONNECTIONS_MAX];
+	struct watched watched;
+};
+
+avc1394_plug_graph *avc1394_plug_graph_new(raw1394handle_t handle,
+	nodeid_t node, int watch)
+{
+	avc1394_plug_graph *graph = calloc(1, sizeof(avc1394_plug_graph));
+
+	if (graph == NULL)
+		return NULL;
+	graph->handle = handle;
+	graph->node = node;
+	graph->watch = watch;
+	return graph;
+}
+
+void avc1394_plug_graph_flush(avc1394_plug_graph *graph)
+{
+	watch_stop(&graph->watched);
+}
+
+void avc1394_plug_graph_free(avc1394_plug_graph *graph)
+{
+	avc1394_plug_graph_flush(graph);
+	free(graph);
+}
+
+static int graph_load(avc1394_plug_graph *graph)
+{
+	unsigned char operands[1] = { 0xFF };
+	quadlet_t request[2];
+	int len;
+
+	watch_start(&graph->watched, graph->handle);
+	if (avc1394_plug_info(graph->handle, graph->node, UNIT, &graph->plugs) < 0)
+		return -1;
+	graph->count = avc1394_connections(graph->handle, graph->node,
+		graph->connections, AVC1394_CONNECTIONS_MAX);
+	/* a unit without subunit plugs may not implement CONNECTIONS */
+	if (graph->count < 0)
+		graph->count = 0;
+	graph->watched.valid = 1;
+
+	if (graph->watch) {
+		len = pack_request(request,
+			AVC1394_CTYPE_NOTIFY | UNIT | AVC1394_COMMAND_CONNECTIONS,
+			operands, 1);
+		htonl_block(request, len);
+		watch_arm(&graph->watched, graph->node, request, len, 0);
+	}
+	return 0;
+}
+
+int avc1394_plug_graph_get(avc1394_plug_graph *graph, avc1394_plugs *plugs,
+	avc1394_connection **connections)
+{
+	if (!watch_check(&graph->watched) && graph_load(graph) < 0)
+		return -1;
+	if (plugs != NULL)
+		*plugs = graph->plugs;
+	if (connections != NULL)
+		*connections = graph->connections;
+	return graph->count;
+}
+
+static int same_ends(const avc1394_connection *a, const avc1394_connection *b)
+{
+	return a->source_subunit == b->source_subunit
+		&& a->source_plug == b->source_plug
+		&& a->destination_subunit == b->destination_subunit
+		&& a->destination_plug == b->destination_plug;
+}
+
+int avc1394_plug_graph_connect(avc1394_plug_graph *graph,
+	const avc1394_connection *connection)
+{
+	int i, result;
+
+	watch_check(&graph->watched);
+	result = avc1394_connect(graph->handle, graph->node, connection);
+	/* take the CHANGED our own connection causes */
+	if (result != AVC1394_RESP_ACCEPTED || !watch_absorb(&graph->watched))
+		return result;
+
+	/* a destination has at most one source */
+	for (i = 0; i < graph->count; i++)
+		if (graph->connections[i].destination_subunit == connection->destination_subunit
+				&& graph->connections[i].destination_plug == connection->destination_plug)
+			break;
+	if (i < AVC1394_CONNECTIONS_MAX) {
+		graph->connections[i] = *connection;
+		if (i == graph->count)
+			graph->count++;
+	} else
+		avc1394_plug_graph_flush(graph);
+	return result;
+}
+
+int avc1394_plug_graph_disconnect(avc1394_plug_graph *graph,
+	const avc1394_connection *connection)
+{
+	int i, result;
+
+	watch_check(&graph->watched);
+	result = avc1394_disconnect(graph->handle, graph->node, connection);
+	if (result != AVC1394_RESP_ACCEPTED || !watch_absorb(&graph->watched))
+		return result;
+
+	for (i = 0; i < graph->count; i++)
+		if (same_ends(&graph->connections[i], connection)) {
+			graph->connections[i] = graph->connections[--graph->count];
+			break;
+		}
+	return result;
+}
@@ -22,10 +22,11 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <netinet/in.h>
 #include "avc1394_vcr.h"
 #include "avc1394.h"
-
-#define AVC1394_RETRY 2
+#include "avc1394_internal.h"
 
 #define CTLVCR0 AVC1394_CTYPE_CONTROL | AVC1394_SUBUNIT_TYPE_TAPE_RECORDER | AVC1394_SUBUNIT_ID_0
 #define STATVCR0 AVC1394_CTYPE_STATUS | AVC1394_SUBUNIT_TYPE_TAPE_RECORDER | AVC1394_SUBUNIT_ID_0
@@ -35,182 +36,333 @@
 #define CTLUNIT AVC1394_CTYPE_CONTROL | AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE
 #define STATUNIT AVC1394_CTYPE_STATUS | AVC1394_SUBUNIT_TYPE_UNIT | AVC1394_SUBUNIT_ID_IGNORE
 
-int avc1394_vcr_is_playing(raw1394handle_t handle, nodeid_t node)
+/* extract the play or record mode from a TRANSPORT STATE status response */
+static int vcr_playing_mode(quadlet_t status)
 {
-	quadlet_t response = avc1394_transaction(handle, node, STATVCR0
-		| AVC1394_VCR_COMMAND_TRANSPORT_STATE | AVC1394_VCR_OPERAND_TRANSPORT_STATE,
-		AVC1394_RETRY);
-	if (AVC1394_MASK_OPCODE(response)
+	if (AVC1394_MASK_OPCODE(status)
 		== AVC1394_VCR_RESPONSE_TRANSPORT_STATE_PLAY)
-		return AVC1394_GET_OPERAND0(response);
+		return AVC1394_GET_OPERAND0(status);
 	else
 		return 0;
 }
 
 
-int avc1394_vcr_is_recording(raw1394handle_t handle, nodeid_t node)
+static int vcr_recording_mode(quadlet_t status)
 {
-	quadlet_t response = avc1394_transaction(handle, node, STATVCR0
-		| AVC1394_VCR_COMMAND_TRANSPORT_STATE | AVC1394_VCR_OPERAND_TRANSPORT_STATE,
-		AVC1394_RETRY);
-	if (AVC1394_MASK_OPCODE(response)
+	if (AVC1394_MASK_OPCODE(status)
 		== AVC1394_VCR_RESPONSE_TRANSPORT_STATE_RECORD)
-		return AVC1394_GET_OPERAND0(response);
+		return AVC1394_GET_OPERAND0(status);
 	else
 		return 0;
 }
 
 
-void avc1394_vcr_play(raw1394handle_t handle, nodeid_t node)
+int avc1394_vcr_is_playing(raw1394handle_t handle, nodeid_t node)
+{
+	return vcr_playing_mode(avc1394_vcr_status(handle, node));
+}
+
+
+int avc1394_vcr_is_recording(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node) == AVC1394_VCR_OPERAND_PLAY_FORWARD) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_SLOWEST_FORWARD);
-	} else {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FORWARD);
+	return vcr_recording_mode(avc1394_vcr_status(handle, node));
+}
+
+
+/* the fixed transport commands, encoded once when compiled */
+enum vcr_frame {
+#define AVC1394_VCR_FRAME(name, command, operand, len, extra) VCR_##name,
+#include "avc1394_commands.def"
+	VCR_FRAMES
+};
+
+static const struct fcp_frame vcr_frames[VCR_FRAMES] = {
+#define AVC1394_VCR_FRAME(name, command, operand, len, extra) \
+	FCP_FRAME(len, CTLVCR0 | AVC1394_VCR_COMMAND_##command, operand, extra),
+#include "avc1394_commands.def"
+};
+
+/* the frame carrying out operation in status, or -1 if there is none */
+static int vcr_frame(enum avc1394_vcr_operation operation, quadlet_t status,
+	int arg)
+{
+	int mode;
+
+	switch (operation) {
+	case AVC1394_VCR_OP_PLAY:
+		if (vcr_playing_mode(status) == AVC1394_VCR_OPERAND_PLAY_FORWARD)
+			return VCR_PLAY_SLOWEST_FORWARD;
+		return VCR_PLAY_FORWARD;
+
+	case AVC1394_VCR_OP_REVERSE:
+		if (vcr_playing_mode(status) == AVC1394_VCR_OPERAND_PLAY_REVERSE)
+			return VCR_PLAY_SLOWEST_REVERSE;
+		return VCR_PLAY_REVERSE;
+
+	case AVC1394_VCR_OP_TRICK_PLAY:
+		if (vcr_recording_mode(status))
+			return -1;
+		if (arg == 0)
+			return VCR_PLAY_FORWARD;
+		if (arg > 0) {
+			if (arg > 14) arg = 14;
+			return VCR_PLAY_SLOWEST_FORWARD + arg - 1;
+		}
+		if (arg < -14) arg = -14;
+		return VCR_PLAY_SLOWEST_REVERSE - arg - 1;
+
+	case AVC1394_VCR_OP_STOP:
+		return VCR_WIND_STOP;
+
+	case AVC1394_VCR_OP_REWIND:
+		if (vcr_playing_mode(status))
+			return VCR_PLAY_FASTEST_REVERSE;
+		return VCR_WIND_REWIND;
+
+	case AVC1394_VCR_OP_PAUSE:
+		if ((mode = vcr_recording_mode(status))) {
+			if (mode == AVC1394_VCR_OPERAND_RECORD_PAUSE)
+				return VCR_RECORD_RECORD;
+			return VCR_RECORD_PAUSE;
+		}
+		if (vcr_playing_mode(status) == AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE)
+			return VCR_PLAY_FORWARD;
+		return VCR_PLAY_FORWARD_PAUSE;
+
+	case AVC1394_VCR_OP_FORWARD:
+		if (vcr_playing_mode(status))
+			return VCR_PLAY_FASTEST_FORWARD;
+		return VCR_WIND_FAST_FORWARD;
+
+	case AVC1394_VCR_OP_NEXT:
+		if (!vcr_playing_mode(status))
+			return -1;
+		return VCR_PLAY_NEXT_FRAME;
+
+	case AVC1394_VCR_OP_NEXT_INDEX:
+		if (!vcr_playing_mode(status))
+			return -1;
+		return VCR_FORWARD_INDEX;
+
+	case AVC1394_VCR_OP_PREVIOUS:
+		if (!vcr_playing_mode(status))
+			return -1;
+		return VCR_PLAY_PREVIOUS_FRAME;
+
+	case AVC1394_VCR_OP_PREVIOUS_INDEX:
+		if (!vcr_playing_mode(status))
+			return -1;
+		return VCR_BACKWARD_INDEX;
+
+	case AVC1394_VCR_OP_EJECT:
+		return VCR_LOAD_MEDIUM_EJECT;
+
+	case AVC1394_VCR_OP_RECORD:
+		return VCR_RECORD_RECORD;
 	}
+	return -1;
+}
+
+
+int avc1394_vcr_build_command(enum avc1394_vcr_operation operation,
+	quadlet_t status, int arg, quadlet_t *request)
+{
+	int i, f = vcr_frame(operation, status, arg);
+
+	if (f < 0)
+		return 0;
+	for (i = 0; i < vcr_frames[f].len; i++)
+		request[i] = ntohl(vcr_frames[f].data.quadlets[i]);
+	return vcr_frames[f].len;
+}
+
+
+/* fire and forget, as the classic interface always has */
+static void vcr_send(raw1394handle_t handle, nodeid_t node,
+	enum avc1394_vcr_operation operation, quadlet_t status, int arg)
+{
+	int f = vcr_frame(operation, status, arg);
+
+	if (f >= 0)
+		send_frame(handle, node, vcr_frames[f].data.quadlets, vcr_frames[f].len);
+}
+
+
+avc1394_pending *avc1394_vcr_control_start(raw1394handle_t handle, nodeid_t node,
+	enum avc1394_vcr_operation operation, quadlet_t status, int arg)
+{
+	int f = vcr_frame(operation, status, arg);
+
+	if (f < 0)
+		return NULL;
+	return pending_start_frame(handle, node, vcr_frames[f].data.quadlets,
+		vcr_frames[f].len);
+}
+
+
+int avc1394_vcr_control(raw1394handle_t handle, nodeid_t node,
+	enum avc1394_vcr_operation operation, quadlet_t status, int arg,
+	quadlet_t *response)
+{
+	int f = vcr_frame(operation, status, arg);
+	avc1394_pending *pending;
+	int result;
+
+	if (f < 0)
+		return 0;
+	pending = pending_start_frame(handle, node, vcr_frames[f].data.quadlets,
+		vcr_frames[f].len);
+	if (pending == NULL)
+		return -1;
+	result = avc1394_transaction_wait(pending);
+	if (result >= 0 && response != NULL)
+		*response = avc1394_transaction_response(pending, NULL)[0];
+	avc1394_transaction_finish(pending);
+	return result;
+}
+
+
+void avc1394_vcr_play(raw1394handle_t handle, nodeid_t node)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_PLAY, avc1394_vcr_status(handle, node), 0);
+}
+
+
+void avc1394_vcr_play_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_PLAY, status, 0);
 }
 
 
 void avc1394_vcr_reverse(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node) == AVC1394_VCR_OPERAND_PLAY_REVERSE) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_SLOWEST_REVERSE);
-	} else {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_REVERSE);
-	}
+	vcr_send(handle, node, AVC1394_VCR_OP_REVERSE, avc1394_vcr_status(handle, node), 0);
+}
+
+
+void avc1394_vcr_reverse_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_REVERSE, status, 0);
 }
 
 
 void avc1394_vcr_trick_play(raw1394handle_t handle, nodeid_t node, int speed)
 {
-	if (!avc1394_vcr_is_recording(handle, node)) {
-	    if (speed == 0) {
-		    avc1394_send_command(handle, node, CTLVCR0
-			    | AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FORWARD);
-	    } else if (speed > 0) {
-	        if (speed > 14) speed = 14;
-		    avc1394_send_command(handle, node, CTLVCR0
-			    | AVC1394_VCR_COMMAND_PLAY | (AVC1394_VCR_OPERAND_PLAY_NEXT_FRAME + speed));	        
-	    } else {
-	        if (speed < -14) speed = -14;
-		    avc1394_send_command(handle, node, CTLVCR0
-			    | AVC1394_VCR_COMMAND_PLAY | (AVC1394_VCR_OPERAND_PLAY_PREVIOUS_FRAME - speed));	        
-	    }
-	}
+	vcr_send(handle, node, AVC1394_VCR_OP_TRICK_PLAY,
+		avc1394_vcr_status(handle, node), speed);
+}
+
+
+void avc1394_vcr_trick_play_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status, int speed)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_TRICK_PLAY, status, speed);
 }
 
 
 void avc1394_vcr_stop(raw1394handle_t handle, nodeid_t node)
 {
-	avc1394_send_command(handle, node, CTLVCR0
-		| AVC1394_VCR_COMMAND_WIND | AVC1394_VCR_OPERAND_WIND_STOP);
+	vcr_send(handle, node, AVC1394_VCR_OP_STOP, 0, 0);
 }
 
 
 void avc1394_vcr_rewind(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node)) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FASTEST_REVERSE);
-	} else {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_WIND | AVC1394_VCR_OPERAND_WIND_REWIND);
-	}
+	vcr_send(handle, node, AVC1394_VCR_OP_REWIND, avc1394_vcr_status(handle, node), 0);
+}
+
+
+void avc1394_vcr_rewind_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_REWIND, status, 0);
 }
 
 
+/* one status query serves both the record and the play checks */
 void avc1394_vcr_pause(raw1394handle_t handle, nodeid_t node)
 {
-	int mode;
-	
-	if ((mode = avc1394_vcr_is_recording(handle, node))) {
-		if (mode == AVC1394_VCR_OPERAND_RECORD_PAUSE) {
-			avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_RECORD | AVC1394_VCR_OPERAND_RECORD_RECORD);
-		} else {
-			avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_RECORD | AVC1394_VCR_OPERAND_RECORD_PAUSE);
-		}
-	} else {
-		if (avc1394_vcr_is_playing(handle, node)==AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE) {
-			avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FORWARD);
-		} else {
-			avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE);
-		}
-	}
+	vcr_send(handle, node, AVC1394_VCR_OP_PAUSE, avc1394_vcr_status(handle, node), 0);
+}
+
 
+void avc1394_vcr_pause_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_PAUSE, status, 0);
 }
 
 
 void avc1394_vcr_forward(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node)) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_FASTEST_FORWARD);
-	} else {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_WIND | AVC1394_VCR_OPERAND_WIND_FAST_FORWARD);
+	vcr_send(handle, node, AVC1394_VCR_OP_FORWARD, avc1394_vcr_status(handle, node), 0);
+}
 
-	}
+
+void avc1394_vcr_forward_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_FORWARD, status, 0);
 }
 
 
 void avc1394_vcr_next(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node)) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_NEXT_FRAME);
-	} 
+	vcr_send(handle, node, AVC1394_VCR_OP_NEXT, avc1394_vcr_status(handle, node), 0);
+}
+
+
+void avc1394_vcr_next_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_NEXT, status, 0);
 }
 
 void avc1394_vcr_next_index(raw1394handle_t handle, nodeid_t node)
 {
-    quadlet_t request[2];
-	if (avc1394_vcr_is_playing(handle, node)) {
-	    request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_FORWARD | 
-	        AVC1394_VCR_MEASUREMENT_INDEX;
-	    request[1] = 0x01FFFFFF;
-		avc1394_send_command_block(handle, node, request, 2);
-	} 
+	vcr_send(handle, node, AVC1394_VCR_OP_NEXT_INDEX, avc1394_vcr_status(handle, node), 0);
+}
+
+void avc1394_vcr_next_index_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_NEXT_INDEX, status, 0);
 }
 
 void avc1394_vcr_previous(raw1394handle_t handle, nodeid_t node)
 {
-	if (avc1394_vcr_is_playing(handle, node)) {
-		avc1394_send_command(handle, node, CTLVCR0
-			| AVC1394_VCR_COMMAND_PLAY | AVC1394_VCR_OPERAND_PLAY_PREVIOUS_FRAME);
-	} 
+	vcr_send(handle, node, AVC1394_VCR_OP_PREVIOUS, avc1394_vcr_status(handle, node), 0);
+}
+
+void avc1394_vcr_previous_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_PREVIOUS, status, 0);
 }
 
 void avc1394_vcr_previous_index(raw1394handle_t handle, nodeid_t node)
 {
-    quadlet_t request[2];
-	if (avc1394_vcr_is_playing(handle, node)) {
-	    request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_BACKWARD | 
-	        AVC1394_VCR_MEASUREMENT_INDEX;
-	    request[1] = 0x01FFFFFF;
-		avc1394_send_command_block(handle, node, request, 2);
-	} 
+	vcr_send(handle, node, AVC1394_VCR_OP_PREVIOUS_INDEX, avc1394_vcr_status(handle, node), 0);
+}
+
+void avc1394_vcr_previous_index_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status)
+{
+	vcr_send(handle, node, AVC1394_VCR_OP_PREVIOUS_INDEX, status, 0);
 }
 
 
 void avc1394_vcr_eject(raw1394handle_t handle, nodeid_t node)
 {
-	avc1394_send_command(handle, node, CTLVCR0
-		| AVC1394_VCR_COMMAND_LOAD_MEDIUM | AVC1394_VCR_OPERAND_LOAD_MEDIUM_EJECT);
+	vcr_send(handle, node, AVC1394_VCR_OP_EJECT, 0, 0);
 }
 
 
 void avc1394_vcr_record(raw1394handle_t handle, nodeid_t node)
 {
-	avc1394_send_command(handle, node, CTLVCR0
-		| AVC1394_VCR_COMMAND_RECORD | AVC1394_VCR_OPERAND_RECORD_RECORD);
+	vcr_send(handle, node, AVC1394_VCR_OP_RECORD, 0, 0);
 }
 
 quadlet_t avc1394_vcr_status(raw1394handle_t handle, nodeid_t node)
@@ -221,58 +373,99 @@ quadlet_t avc1394_vcr_status(raw1394handle_t handle, nodeid_t node)
 
 }
 
+/* TRANSPORT STATE opcodes to their mode */
+static const unsigned char vcr_modes[256] = {
+#define AVC1394_VCR_MODE(id, state, name) \
+	[AVC1394_VCR_RESPONSE_TRANSPORT_STATE_##id >> 8] = AVC1394_VCR_MODE_##id,
+#include "avc1394_commands.def"
+};
+
+/* the state of each mode, unless vcr_states has one for the operand */
+static const unsigned char vcr_mode_states[] = {
+	[AVC1394_VCR_MODE_UNKNOWN] = AVC1394_VCR_STATE_UNKNOWN,
+#define AVC1394_VCR_MODE(id, state, name) \
+	[AVC1394_VCR_MODE_##id] = AVC1394_VCR_STATE_##state,
+#include "avc1394_commands.def"
+};
+
+static const unsigned char vcr_states[sizeof(vcr_mode_states)][256] = {
+#define AVC1394_VCR_STATE_OPERAND(mode, operand, state) \
+	[AVC1394_VCR_MODE_##mode][operand] = AVC1394_VCR_STATE_##state,
+#include "avc1394_commands.def"
+};
+
+static const unsigned char vcr_media[256] = {
+#define AVC1394_VCR_MEDIUM(id, operand, name) [operand] = AVC1394_VCR_MEDIUM_##id,
+#include "avc1394_commands.def"
+};
+
+static const char *const vcr_mode_names[] = {
+	[AVC1394_VCR_MODE_UNKNOWN] = "Unknown",
+#define AVC1394_VCR_MODE(id, state, name) [AVC1394_VCR_MODE_##id] = name,
+#include "avc1394_commands.def"
+};
+
+static const char *const vcr_state_names[] = {
+	[AVC1394_VCR_STATE_UNKNOWN] = "Unknown",
+#define AVC1394_VCR_STATE(id, name) [AVC1394_VCR_STATE_##id] = name,
+#include "avc1394_commands.def"
+};
+
+static const char *const vcr_medium_names[] = {
+	[AVC1394_VCR_MEDIUM_UNKNOWN] = "Unknown",
+#define AVC1394_VCR_MEDIUM(id, operand, name) [AVC1394_VCR_MEDIUM_##id] = name,
+#include "avc1394_commands.def"
+};
+
+#define NAMES(table) (sizeof(table) / sizeof(table[0]))
+
+enum avc1394_vcr_mode avc1394_vcr_decode_mode(quadlet_t response)
+{
+	return vcr_modes[AVC1394_MASK_OPCODE(response) >> 8];
+}
+
+enum avc1394_vcr_state avc1394_vcr_decode_state(quadlet_t response)
+{
+	enum avc1394_vcr_mode mode = avc1394_vcr_decode_mode(response);
+	enum avc1394_vcr_state state;
+
+	if (response == 0)
+		return AVC1394_VCR_STATE_OK;
+	state = vcr_states[mode][AVC1394_GET_OPERAND0(response)];
+	return state != AVC1394_VCR_STATE_UNKNOWN ? state : vcr_mode_states[mode];
+}
+
+enum avc1394_vcr_medium avc1394_vcr_decode_medium(quadlet_t response)
+{
+	return vcr_media[AVC1394_GET_OPERAND0(response)];
+}
+
+const char *avc1394_vcr_mode_name(enum avc1394_vcr_mode mode)
+{
+	return vcr_mode_names[(unsigned int) mode < NAMES(vcr_mode_names) ? mode : 0];
+}
+
+const char *avc1394_vcr_state_name(enum avc1394_vcr_state state)
+{
+	return vcr_state_names[(unsigned int) state < NAMES(vcr_state_names) ? state : 0];
+}
+
+const char *avc1394_vcr_medium_name(enum avc1394_vcr_medium medium)
+{
+	return vcr_medium_names[(unsigned int) medium < NAMES(vcr_medium_names) ? medium : 0];
+}
+
 char *avc1394_vcr_decode_status(quadlet_t response)
 {
-	/*quadlet_t resp0 = AVC1394_MASK_RESPONSE_OPERAND(response, 0);
-	quadlet_t resp1 = AVC1394_MASK_RESPONSE_OPERAND(response, 1);*/
-	quadlet_t resp2 = AVC1394_MASK_RESPONSE_OPERAND(response, 2);
-	quadlet_t resp3 = AVC1394_MASK_RESPONSE_OPERAND(response, 3);
-	
-	if (response == 0) {
-		return "OK";
-	} else if (resp2 == AVC1394_VCR_RESPONSE_TRANSPORT_STATE_LOAD_MEDIUM) {
-		return("Loading Medium");
-	} else if (resp2 == AVC1394_VCR_RESPONSE_TRANSPORT_STATE_RECORD) {
-		if (resp3 == AVC1394_VCR_OPERAND_RECORD_PAUSE)
-			return("Recording Paused");
-		else
-			return("Recording");
-	} else if (resp2 == AVC1394_VCR_RESPONSE_TRANSPORT_STATE_PLAY) {
-		if (resp3 >= AVC1394_VCR_OPERAND_PLAY_FAST_FORWARD_1
-				&& resp3 <= AVC1394_VCR_OPERAND_PLAY_FASTEST_FORWARD) {
-			return("Playing Fast Forward");
-		} else if (resp3 >= AVC1394_VCR_OPERAND_PLAY_FAST_REVERSE_1
-					&& resp3 <= AVC1394_VCR_OPERAND_PLAY_FASTEST_REVERSE) {
-			return("Playing Reverse");
-		} else if (resp3 == AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE) {
-			return("Playing Paused");
-		} else {
-			return("Playing");
-		}
-	} else if (resp2 == AVC1394_VCR_RESPONSE_TRANSPORT_STATE_WIND) {
-		if (resp3 == AVC1394_VCR_OPERAND_WIND_HIGH_SPEED_REWIND) {
-			return("Winding backward at incredible speed");
-		} else if (resp3 == AVC1394_VCR_OPERAND_WIND_STOP) {
-			return("Winding stopped");
-		} else if (resp3 == AVC1394_VCR_OPERAND_WIND_REWIND) {
-			return("Winding reverse");
-		} else if (resp3 == AVC1394_VCR_OPERAND_WIND_FAST_FORWARD) {
-			return("Winding forward");
-		} else {
-			return("Winding");
-		}
-	} else {
-		return("Unknown");
-	}
+	return (char *) avc1394_vcr_state_name(avc1394_vcr_decode_state(response));
 }
 
-/* Get the time code on tape in format HH:MM:SS:FF */
-char *
-avc1394_vcr_get_timecode(raw1394handle_t handle, nodeid_t node)
+/* read the raw consumer timecode operand, in BCD */
+static int vcr_timecode_quadlet(raw1394handle_t handle, nodeid_t node,
+	quadlet_t *timecode)
 {
 	quadlet_t  request[2];
 	quadlet_t *response;
-	char      *output = NULL;
 		
 	request[0] = STATVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
 		AVC1394_VCR_OPERAND_TIME_CODE_STATUS;
@@ -280,19 +473,32 @@ avc1394_vcr_get_timecode(raw1394handle_t handle, nodeid_t node)
 	response = avc1394_transaction_block(handle, node, request, 2, AVC1394_RETRY);
 	if (response == NULL || response[1] == 0xffffffff) {
 		avc1394_transaction_block_close(handle);
-		return NULL;
+		return -1;
 	}
+	*timecode = response[1];
+	avc1394_transaction_block_close(handle);
+	return 0;
+}
+
+/* Get the time code on tape in format HH:MM:SS:FF */
+char *
+avc1394_vcr_get_timecode(raw1394handle_t handle, nodeid_t node)
+{
+	quadlet_t  timecode;
+	char      *output = NULL;
+		
+	if (vcr_timecode_quadlet(handle, node, &timecode) < 0)
+		return NULL;
 	
 	output = malloc(12);
 	if (output)
 		// consumer timecode format
 		sprintf(output, "%2.2x:%2.2x:%2.2x:%2.2x",
-			response[1] & 0x000000ff,
-			(response[1] >> 8) & 0x000000ff,
-			(response[1] >> 16) & 0x000000ff,
-			(response[1] >> 24) & 0x000000ff);
+			timecode & 0x000000ff,
+			(timecode >> 8) & 0x000000ff,
+			(timecode >> 16) & 0x000000ff,
+			(timecode >> 24) & 0x000000ff);
 
-	avc1394_transaction_block_close(handle);
 	return output;
 }
 
@@ -300,48 +506,453 @@ avc1394_vcr_get_timecode(raw1394handle_t handle, nodeid_t node)
 int
 avc1394_vcr_get_timecode2(raw1394handle_t handle, nodeid_t node, char *output)
 {
-	quadlet_t  request[2];
-	quadlet_t *response;
+	quadlet_t  timecode;
 		
-	request[0] = STATVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
-		AVC1394_VCR_OPERAND_TIME_CODE_STATUS;
-	request[1] = 0xFFFFFFFF;
-	response = avc1394_transaction_block(handle, node, request, 2, AVC1394_RETRY);
-	if (response == NULL || response[1] == 0xffffffff) {
-		avc1394_transaction_block_close(handle);
+	if (vcr_timecode_quadlet(handle, node, &timecode) < 0)
 		return -1;
-	}
 
 	// consumer timecode format
 	sprintf(output, "%2.2x:%2.2x:%2.2x:%2.2x",
-		response[1] & 0x000000ff,
-		(response[1] >> 8) & 0x000000ff,
-		(response[1] >> 16) & 0x000000ff,
-		(response[1] >> 24) & 0x000000ff);
+		timecode & 0x000000ff,
+		(timecode >> 8) & 0x000000ff,
+		(timecode >> 16) & 0x000000ff,
+		(timecode >> 24) & 0x000000ff);
 	
-	avc1394_transaction_block_close(handle);
 	return 0;
 }
 
+#define BCD(x) ((((x) >> 4) & 0xF) * 10 + ((x) & 0xF))
+
+/* Get the time code on tape in binary */
+int
+avc1394_vcr_read_timecode(raw1394handle_t handle, nodeid_t node,
+	avc1394_timecode *tc)
+{
+	quadlet_t  timecode;
+
+	if (vcr_timecode_quadlet(handle, node, &timecode) < 0)
+		return -1;
+
+	/* mask off the flag bits above the tens digits */
+	tc->hours = BCD(timecode & 0x3f);
+	tc->minutes = BCD((timecode >> 8) & 0x7f);
+	tc->seconds = BCD((timecode >> 16) & 0x7f);
+	tc->frames = BCD((timecode >> 24) & 0x3f);
+	return 0;
+}
+
+long
+avc1394_timecode_to_frames(const avc1394_timecode *tc, int fps)
+{
+	return ((tc->hours * 60L + tc->minutes) * 60L + tc->seconds) * fps
+		+ tc->frames;
+}
 
-/* Go to the time code on tape in format HH:MM:SS:FF */
 void
-avc1394_vcr_seek_timecode(raw1394handle_t handle, nodeid_t node, char *timecode)
+avc1394_timecode_from_frames(avc1394_timecode *tc, long frames, int fps)
+{
+	if (frames < 0)
+		frames = 0;
+	tc->frames = frames % fps;
+	frames /= fps;
+	tc->seconds = frames % 60;
+	frames /= 60;
+	tc->minutes = frames % 60;
+	tc->hours = (frames / 60) % 24;
+}
+
+
+/*
+ * Timecode tracker
+ *
+ * The timecode is sampled at most once per interval; in between it is
+ * extrapolated from the last sample using the transport speed and the
+ * monotonic clock. Only normal speed play and record (forward or reverse)
+ * and the stopped and paused states have a known speed; at any other
+ * speed the last sample is held until the next one.
+ */
+
+/* frames per second of playback, times 1000 */
+static long tracker_rate(int fps)
+{
+	/* 30 frame timecode runs on 29.97 frame NTSC video */
+	return fps == 30 ? 30000000L / 1001 : fps * 1000L;
+}
+
+static int tracker_speed(quadlet_t status)
+{
+	switch (AVC1394_MASK_OPCODE(status)) {
+	case AVC1394_VCR_RESPONSE_TRANSPORT_STATE_PLAY:
+		switch (AVC1394_GET_OPERAND0(status)) {
+		case AVC1394_VCR_OPERAND_PLAY_FORWARD:
+		case AVC1394_VCR_OPERAND_PLAY_X1_FORWARD:
+			return 1;
+		case AVC1394_VCR_OPERAND_PLAY_REVERSE:
+		case AVC1394_VCR_OPERAND_PLAY_X1_REVERSE:
+			return -1;
+		}
+		break;
+	case AVC1394_VCR_RESPONSE_TRANSPORT_STATE_RECORD:
+		if (AVC1394_GET_OPERAND0(status) == AVC1394_VCR_OPERAND_RECORD_RECORD)
+			return 1;
+		break;
+	}
+	return 0;
+}
+
+/* milliseconds between two clock readings */
+static long tracker_elapsed(struct timespec *from, struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000L
+		+ (to->tv_nsec - from->tv_nsec) / 1000000L;
+}
+
+/* frame count extrapolated to now */
+static long tracker_extrapolate(avc1394_vcr_tracker *tracker, struct timespec *now)
+{
+	long long ms = tracker_elapsed(&tracker->sampled, now);
+
+	return tracker->frame + tracker->speed
+		* (ms * tracker_rate(tracker->fps) + 500000) / 1000000;
+}
+
+void
+avc1394_vcr_tracker_init(avc1394_vcr_tracker *tracker, raw1394handle_t handle,
+	nodeid_t node, int fps, int interval)
+{
+	tracker->handle = handle;
+	tracker->node = node;
+	tracker->fps = fps;
+	tracker->interval = interval;
+	tracker->status = 0;
+	tracker->speed = 0;
+	tracker->frame = -1;
+	tracker->valid = 0;
+}
+
+int
+avc1394_vcr_tracker_sample(avc1394_vcr_tracker *tracker)
+{
+	avc1394_timecode tc;
+	struct timespec before, after;
+	quadlet_t status;
+
+	status = avc1394_vcr_status(tracker->handle, tracker->node);
+	if (status == (quadlet_t) -1)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	if (avc1394_vcr_read_timecode(tracker->handle, tracker->node, &tc) < 0) {
+		tracker->valid = 0;
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	/* the device sampled somewhere in the round-trip; assume the middle */
+	tracker->sampled = before;
+	tracker->sampled.tv_nsec += tracker_elapsed(&before, &after) * 500000L;
+	tracker->sampled.tv_sec += tracker->sampled.tv_nsec / 1000000000L;
+	tracker->sampled.tv_nsec %= 1000000000L;
+	tracker->status = status;
+	tracker->speed = tracker_speed(status);
+	tracker->frame = avc1394_timecode_to_frames(&tc, tracker->fps);
+	tracker->valid = 1;
+	return 0;
+}
+
+void
+avc1394_vcr_tracker_set_status(avc1394_vcr_tracker *tracker, quadlet_t status)
+{
+	struct timespec now;
+
+	if (tracker->valid) {
+		/* rebase so the new speed only applies from now on */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tracker->frame = tracker_extrapolate(tracker, &now);
+		tracker->sampled = now;
+	}
+	tracker->status = status;
+	tracker->speed = tracker_speed(status);
+}
+
+long
+avc1394_vcr_tracker_frames(avc1394_vcr_tracker *tracker)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!tracker->valid
+			|| tracker_elapsed(&tracker->sampled, &now) >= tracker->interval) {
+		if (avc1394_vcr_tracker_sample(tracker) < 0)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+	return tracker_extrapolate(tracker, &now);
+}
+
+int
+avc1394_vcr_tracker_timecode(avc1394_vcr_tracker *tracker, avc1394_timecode *tc)
+{
+	long frames = avc1394_vcr_tracker_frames(tracker);
+
+	if (frames < 0)
+		return -1;
+	avc1394_timecode_from_frames(tc, frames, tracker->fps);
+	return 0;
+}
+
+/* pack HH:MM:SS:FF into the consumer timecode operand */
+static quadlet_t vcr_parse_timecode(char *timecode)
 {
-	quadlet_t  request[2];
 	unsigned int hh,mm,ss,ff;
-		
-	request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
-		AVC1394_VCR_OPERAND_TIME_CODE_CONTROL;
-	
+
 	// consumer timecode format
 	sscanf(timecode, "%2x:%2x:%2x:%2x", &hh, &mm, &ss, &ff);
-	request[1] = 
+	return
 		((ff & 0x000000ff) << 24) |
 		((ss & 0x000000ff) << 16) |
 		((mm & 0x000000ff) <<  8) |
 		((hh & 0x000000ff) <<  0) ;
-	printf("timecode: %08x\n", request[1]);
+}
+
+/* Go to the time code on tape in format HH:MM:SS:FF */
+void
+avc1394_vcr_seek_timecode(raw1394handle_t handle, nodeid_t node, char *timecode)
+{
+	quadlet_t  request[2];
+		
+	request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
+		AVC1394_VCR_OPERAND_TIME_CODE_CONTROL;
+	request[1] = vcr_parse_timecode(timecode);
+#ifdef DEBUG
+	fprintf(stderr, "timecode: %08x\n", request[1]);
+#endif
 	
 	avc1394_send_command_block( handle, node, request, 2);
 }
+
+/* Go to the time code on tape and return the device's response */
+int
+avc1394_vcr_seek_timecode2(raw1394handle_t handle, nodeid_t node, char *timecode)
+{
+	quadlet_t  request[2];
+	avc1394_pending *pending;
+	int result;
+
+	request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
+		AVC1394_VCR_OPERAND_TIME_CODE_CONTROL;
+	request[1] = vcr_parse_timecode(timecode);
+
+	pending = avc1394_transaction_start(handle, node, request, 2);
+	if (pending == NULL)
+		return -1;
+	result = avc1394_transaction_wait(pending);
+	avc1394_transaction_finish(pending);
+	return result;
+}
+
+
+/*
+ * Closed-loop seek
+ */
+
+/* pack a binary time code into the consumer timecode operand */
+static quadlet_t vcr_encode_timecode(const avc1394_timecode *tc)
+{
+	return
+		(((tc->frames / 10) << 4 | tc->frames % 10) << 24) |
+		(((tc->seconds / 10) << 4 | tc->seconds % 10) << 16) |
+		(((tc->minutes / 10) << 4 | tc->minutes % 10) <<  8) |
+		(((tc->hours / 10) << 4 | tc->hours % 10) <<  0) ;
+}
+
+static void vcr_sleep(long ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+/* position polling interval for a given distance and transport speed in
+   frames per second: about half the expected travel time */
+static long vcr_seek_interval(long distance, long speed, int fps)
+{
+	long ms;
+
+	if (speed <= 0)
+		return AVC1394_VCR_SEEK_MAX_INTERVAL;
+	ms = distance * 500 / speed;
+	if (ms < 1000 / fps)
+		ms = 1000 / fps;
+	if (ms > AVC1394_VCR_SEEK_MAX_INTERVAL)
+		ms = AVC1394_VCR_SEEK_MAX_INTERVAL;
+	return ms;
+}
+
+static int vcr_is_step(quadlet_t command)
+{
+	return command == (CTLVCR0 | AVC1394_VCR_COMMAND_PLAY
+			| AVC1394_VCR_OPERAND_PLAY_NEXT_FRAME)
+		|| command == (CTLVCR0 | AVC1394_VCR_COMMAND_PLAY
+			| AVC1394_VCR_OPERAND_PLAY_PREVIOUS_FRAME);
+}
+
+/* sleep, or wait as long for a held TIME CODE control to finish */
+static void vcr_seek_wait(avc1394_pending *pending, long ms)
+{
+	if (pending != NULL)
+		avc1394_transaction_poll(pending, ms);
+	else
+		vcr_sleep(ms);
+}
+
+/* paused or stepping frames */
+static int vcr_is_still(quadlet_t command)
+{
+	return vcr_is_step(command) || command == (CTLVCR0 | AVC1394_VCR_COMMAND_PLAY
+			| AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE);
+}
+
+int
+avc1394_vcr_seek(raw1394handle_t handle, nodeid_t node,
+	const avc1394_timecode *target, int fps, int tolerance, int timeout,
+	avc1394_vcr_seek_result *result)
+{
+	avc1394_vcr_seek_result r;
+	avc1394_timecode tc;
+	avc1394_pending *pending;
+	struct timespec start, now;
+	quadlet_t request[2];
+	quadlet_t command, current = 0;
+	long goal = avc1394_timecode_to_frames(target, fps);
+	long distance, last = -1, wait = 0;
+	int direction = 0, device_seek, settled = 0;
+
+	r.response = -1;
+	r.frames = -1;
+	r.elapsed = 0;
+	r.passes = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* Let the device seek by itself if it can. A deck that does may hold
+	   the command with INTERIM until it gets there, far longer than a
+	   transaction wait, so it stays open while the position is followed.
+	   It has to echo the control operand, so that the time code status
+	   reads meanwhile are not taken for its response. */
+	request[0] = CTLVCR0 | AVC1394_VCR_COMMAND_TIME_CODE | 
+		AVC1394_VCR_OPERAND_TIME_CODE_CONTROL;
+	request[1] = vcr_encode_timecode(target);
+	htonl_block(request, 2);
+	pending = pending_start_match(handle, node, request, 2, 1);
+	if (pending != NULL && !avc1394_transaction_poll(pending, AVC1394_POLL_TIMEOUT)
+			&& !pending->interim) {
+		avc1394_transaction_finish(pending);
+		pending = NULL;
+	}
+	if (pending != NULL && pending->done) {
+		r.response = avc1394_transaction_wait(pending);
+		avc1394_transaction_finish(pending);
+		pending = NULL;
+	} else if (pending != NULL) {
+		r.response = AVC1394_RESP_INTERIM;
+	}
+	device_seek = pending != NULL || r.response == AVC1394_RESP_ACCEPTED;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		r.elapsed = tracker_elapsed(&start, &now);
+		if (r.elapsed >= timeout)
+			break;
+
+		/* the held command is through: the deck got there or gave up */
+		if (pending != NULL && avc1394_transaction_poll(pending, 0)) {
+			r.response = avc1394_transaction_wait(pending);
+			avc1394_transaction_finish(pending);
+			pending = NULL;
+			device_seek = (r.response == AVC1394_RESP_ACCEPTED);
+		}
+
+		if (avc1394_vcr_read_timecode(handle, node, &tc) < 0) {
+			/* many decks report no time code while winding */
+			vcr_seek_wait(pending, wait = AVC1394_VCR_SEEK_MAX_INTERVAL);
+			continue;
+		}
+		r.frames = avc1394_timecode_to_frames(&tc, fps);
+		distance = goal - r.frames;
+
+		if (device_seek) {
+			/* the device is seeking; done once it has settled */
+			settled = (r.frames == last) ? settled + 1 : 0;
+			if (labs(distance) <= tolerance && settled)
+				break;
+			/* stopped short of the target: finish the job ourselves,
+			   unless the deck still holds the command */
+			if (settled >= AVC1394_VCR_SEEK_SETTLE_POLLS && pending == NULL)
+				device_seek = 0;
+			wait = vcr_seek_interval(labs(distance), last < 0 || wait == 0 ? 0
+				: labs(r.frames - last) * 1000 / wait, fps);
+			last = r.frames;
+			if (device_seek) {
+				vcr_seek_wait(pending, wait);
+				continue;
+			}
+		}
+
+		if (distance != 0 && direction != 0 && (distance > 0) != (direction > 0))
+			r.passes++;
+		if (distance != 0)
+			direction = distance > 0 ? 1 : -1;
+
+		/* pick the coarsest transport mode suited to the distance */
+		if (labs(distance) <= tolerance) {
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_PLAY
+				| AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE;
+		} else if (labs(distance) > AVC1394_VCR_SEEK_WIND_SECONDS * fps) {
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_WIND | (direction > 0 ?
+				AVC1394_VCR_OPERAND_WIND_FAST_FORWARD : AVC1394_VCR_OPERAND_WIND_REWIND);
+			wait = AVC1394_VCR_SEEK_MAX_INTERVAL;
+		} else if (labs(distance) > AVC1394_VCR_SEEK_SHUTTLE_SECONDS * fps) {
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_PLAY | (direction > 0 ?
+				AVC1394_VCR_OPERAND_PLAY_FASTEST_FORWARD : AVC1394_VCR_OPERAND_PLAY_FASTEST_REVERSE);
+			wait = AVC1394_VCR_SEEK_MAX_INTERVAL;
+		} else if (labs(distance) > fps) {
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_PLAY | (direction > 0 ?
+				AVC1394_VCR_OPERAND_PLAY_X1_FORWARD : AVC1394_VCR_OPERAND_PLAY_X1_REVERSE);
+			wait = vcr_seek_interval(labs(distance), fps, fps);
+		} else if (!vcr_is_still(current)) {
+			/* close in: stop, then step frame by frame */
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_PLAY
+				| AVC1394_VCR_OPERAND_PLAY_FORWARD_PAUSE;
+			wait = 1000 / fps;
+		} else {
+			command = CTLVCR0 | AVC1394_VCR_COMMAND_PLAY | (direction > 0 ?
+				AVC1394_VCR_OPERAND_PLAY_NEXT_FRAME : AVC1394_VCR_OPERAND_PLAY_PREVIOUS_FRAME);
+			wait = 1000 / fps;
+		}
+
+		/* frame steps are repeated, anything else is only sent on change */
+		if (command != current || vcr_is_step(command)) {
+			if (avc1394_transaction(handle, node, command, AVC1394_RETRY)
+					== (quadlet_t) -1)
+				break;
+			current = command;
+		}
+		if (labs(distance) <= tolerance)
+			break;
+		vcr_sleep(wait);
+	}
+
+	/* there, or out of time: give a held command a last chance to finish */
+	if (pending != NULL) {
+		if (avc1394_transaction_poll(pending, AVC1394_POLL_TIMEOUT))
+			r.response = avc1394_transaction_wait(pending);
+		avc1394_transaction_finish(pending);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	r.elapsed = tracker_elapsed(&start, &now);
+	if (result != NULL)
+		*result = r;
+	return (r.frames >= 0 && labs(goal - r.frames) <= tolerance) ? 0 : -1;
+}
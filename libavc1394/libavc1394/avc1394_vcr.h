@@ -23,11 +23,49 @@
 #define AVC1394_VCR_H 1
 
 #include <libraw1394/raw1394.h>
+#include <time.h>
+#include "avc1394.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Time code in binary */
+typedef struct avc1394_timecode_struct {
+	unsigned char	hours;
+	unsigned char	minutes;
+	unsigned char	seconds;
+	unsigned char	frames;
+} avc1394_timecode;
+
+/* Outcome of avc1394_vcr_seek() */
+typedef struct avc1394_vcr_seek_result_struct {
+	int		response;	/* to TIME CODE control: AVC1394_RESP_..., INTERIM
+					   if it was still held, or -1 */
+	long		frames;		/* position reached, -1 if never read */
+	long		elapsed;	/* ms taken */
+	int		passes;		/* times the target was overshot */
+} avc1394_vcr_seek_result;
+
+/* avc1394_vcr_seek() tuning */
+#define AVC1394_VCR_SEEK_WIND_SECONDS 60	/* wind beyond this distance */
+#define AVC1394_VCR_SEEK_SHUTTLE_SECONDS 5	/* fastest play beyond this */
+#define AVC1394_VCR_SEEK_MAX_INTERVAL 250	/* longest poll interval in ms */
+#define AVC1394_VCR_SEEK_SETTLE_POLLS 4	/* unchanged polls before taking over */
+
+/* Time code tracker state, see avc1394_vcr_tracker_init() */
+typedef struct avc1394_vcr_tracker_struct {
+	raw1394handle_t	handle;
+	nodeid_t	node;
+	int		fps;		/* 25 or 30 */
+	int		interval;	/* ms between samples */
+	quadlet_t	status;		/* last transport state */
+	int		speed;		/* -1, 0 or 1 */
+	long		frame;		/* frame count at the last sample */
+	struct timespec	sampled;	/* monotonic time of the last sample */
+	int		valid;
+} avc1394_vcr_tracker;
+
 /* ##### Check to see if device is playing ##### */
 int 
 avc1394_vcr_is_playing(raw1394handle_t handle, nodeid_t node);
@@ -99,6 +137,109 @@ avc1394_vcr_status(raw1394handle_t handle, nodeid_t node);
 char *
 avc1394_vcr_decode_status(quadlet_t response);
 
+/* Transport mode of a TRANSPORT STATE response */
+enum avc1394_vcr_mode {
+	AVC1394_VCR_MODE_UNKNOWN,
+	AVC1394_VCR_MODE_LOAD_MEDIUM,
+	AVC1394_VCR_MODE_RECORD,
+	AVC1394_VCR_MODE_PLAY,
+	AVC1394_VCR_MODE_WIND
+};
+
+/* What the transport is doing, as avc1394_vcr_decode_status() describes it */
+enum avc1394_vcr_state {
+	AVC1394_VCR_STATE_UNKNOWN,
+	AVC1394_VCR_STATE_OK,		/* the response was 0 */
+	AVC1394_VCR_STATE_LOADING,
+	AVC1394_VCR_STATE_RECORDING,
+	AVC1394_VCR_STATE_RECORDING_PAUSED,
+	AVC1394_VCR_STATE_PLAYING,
+	AVC1394_VCR_STATE_PLAYING_FAST_FORWARD,
+	AVC1394_VCR_STATE_PLAYING_REVERSE,
+	AVC1394_VCR_STATE_PLAYING_PAUSED,
+	AVC1394_VCR_STATE_WINDING,
+	AVC1394_VCR_STATE_WINDING_HIGH_SPEED_REWIND,
+	AVC1394_VCR_STATE_WINDING_STOPPED,
+	AVC1394_VCR_STATE_WINDING_REVERSE,
+	AVC1394_VCR_STATE_WINDING_FORWARD
+};
+
+/* Cassette type of a MEDIUM INFO response */
+enum avc1394_vcr_medium {
+	AVC1394_VCR_MEDIUM_UNKNOWN,
+	AVC1394_VCR_MEDIUM_NONE,
+	AVC1394_VCR_MEDIUM_DVCR_STD,
+	AVC1394_VCR_MEDIUM_DVCR_SMALL,
+	AVC1394_VCR_MEDIUM_DVCR_MEDIUM,
+	AVC1394_VCR_MEDIUM_VHS,
+	AVC1394_VCR_MEDIUM_VHSC,
+	AVC1394_VCR_MEDIUM_8MM,
+	AVC1394_VCR_MEDIUM_MICROMV
+};
+
+/* Decode a status response by table lookup; the names are only looked up
+   when asked for */
+enum avc1394_vcr_mode
+avc1394_vcr_decode_mode(quadlet_t response);
+
+enum avc1394_vcr_state
+avc1394_vcr_decode_state(quadlet_t response);
+
+enum avc1394_vcr_medium
+avc1394_vcr_decode_medium(quadlet_t response);
+
+const char *
+avc1394_vcr_mode_name(enum avc1394_vcr_mode mode);
+
+const char *
+avc1394_vcr_state_name(enum avc1394_vcr_state state);
+
+const char *
+avc1394_vcr_medium_name(enum avc1394_vcr_medium medium);
+
+/* The following variants take the transport state from the caller instead
+   of querying the device first, so each costs a single FCP write. Pass the
+   last value returned by avc1394_vcr_status(). */
+void
+avc1394_vcr_play_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_reverse_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_trick_play_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status, int speed);
+
+void
+avc1394_vcr_rewind_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_pause_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_forward_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_next_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_next_index_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_previous_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
+void
+avc1394_vcr_previous_index_from_status(raw1394handle_t handle, nodeid_t node,
+	quadlet_t status);
+
 /* Get the time code on tape in format HH:MM:SS:FF */
 /* This version allocates memory for the string, and 
    the caller is required to free it. */
@@ -110,10 +251,105 @@ __attribute__ ((deprecated));
 int
 avc1394_vcr_get_timecode2(raw1394handle_t handle, nodeid_t node, char *output);
 
+/* Get the time code on tape in binary. Returns 0 or -1 on failure. */
+int
+avc1394_vcr_read_timecode(raw1394handle_t handle, nodeid_t node,
+	avc1394_timecode *tc);
+
+/* Convert between time code and a frame count at fps frames per second */
+long
+avc1394_timecode_to_frames(const avc1394_timecode *tc, int fps);
+
+void
+avc1394_timecode_from_frames(avc1394_timecode *tc, long frames, int fps);
+
+/* Track the time code of a device without a transaction per query. The
+   device is sampled at most every interval milliseconds, and in between the
+   time code is extrapolated from the transport speed and the monotonic
+   clock. Speeds other than normal play or record are held, not
+   extrapolated. */
+void
+avc1394_vcr_tracker_init(avc1394_vcr_tracker *tracker, raw1394handle_t handle,
+	nodeid_t node, int fps, int interval);
+
+/* Sample the transport state and time code now. Returns 0 or -1. */
+int
+avc1394_vcr_tracker_sample(avc1394_vcr_tracker *tracker);
+
+/* Tell the tracker about a transport state change, for example the
+   response from avc1394_vcr_control(), so it need not wait for a sample. */
+void
+avc1394_vcr_tracker_set_status(avc1394_vcr_tracker *tracker, quadlet_t status);
+
+/* The current position as a frame count, or -1 if it is not known */
+long
+avc1394_vcr_tracker_frames(avc1394_vcr_tracker *tracker);
+
+/* The current position as time code. Returns 0 or -1. */
+int
+avc1394_vcr_tracker_timecode(avc1394_vcr_tracker *tracker, avc1394_timecode *tc);
+
 /* Go to the time code on tape in format HH:MM:SS:FF */
 void
 avc1394_vcr_seek_timecode(raw1394handle_t handle, nodeid_t node, char *timecode);
 
+/* As above, but wait for the device and return its AVC1394_RESP_... code,
+   or -1 if it did not respond. */
+int
+avc1394_vcr_seek_timecode2(raw1394handle_t handle, nodeid_t node, char *timecode);
+
+/* Cue the tape to the target time code and wait until it is reached. The
+   device's own TIME CODE seek is used when it accepts one; otherwise the
+   tape is wound, shuttled and finally stepped frame by frame towards the
+   target. The position is polled at an interval adapted to the remaining
+   distance. Succeeds within tolerance frames, gives up after timeout ms.
+   Returns 0 when the target was reached, -1 otherwise. result may be NULL. */
+int
+avc1394_vcr_seek(raw1394handle_t handle, nodeid_t node,
+	const avc1394_timecode *target, int fps, int tolerance, int timeout,
+	avc1394_vcr_seek_result *result);
+
+/* Transport operations for the confirmed control interface below */
+enum avc1394_vcr_operation {
+	AVC1394_VCR_OP_PLAY,
+	AVC1394_VCR_OP_REVERSE,
+	AVC1394_VCR_OP_TRICK_PLAY,
+	AVC1394_VCR_OP_STOP,
+	AVC1394_VCR_OP_REWIND,
+	AVC1394_VCR_OP_PAUSE,
+	AVC1394_VCR_OP_FORWARD,
+	AVC1394_VCR_OP_NEXT,
+	AVC1394_VCR_OP_NEXT_INDEX,
+	AVC1394_VCR_OP_PREVIOUS,
+	AVC1394_VCR_OP_PREVIOUS_INDEX,
+	AVC1394_VCR_OP_EJECT,
+	AVC1394_VCR_OP_RECORD
+};
+
+/* Build the request for an operation given the transport state, as the
+   _from_status variants do; arg is the speed for AVC1394_VCR_OP_TRICK_PLAY.
+   request must hold 2 quadlets. Returns the request length in quadlets, or
+   0 when the operation does nothing in that state. */
+int
+avc1394_vcr_build_command(enum avc1394_vcr_operation operation,
+	quadlet_t status, int arg, quadlet_t *request);
+
+/* Perform an operation and wait for the device's response. Returns the
+   AVC1394_RESP_... code, 0 if nothing was sent, or -1 if the device did not
+   respond. If response is not NULL it receives the response quadlet; for an
+   accepted PLAY, WIND or RECORD it has the layout of a transport state and
+   can be passed as the status of the next call. */
+int
+avc1394_vcr_control(raw1394handle_t handle, nodeid_t node,
+	enum avc1394_vcr_operation operation, quadlet_t status, int arg,
+	quadlet_t *response);
+
+/* Non-blocking form of avc1394_vcr_control(); returns NULL if nothing was
+   sent. Complete it with the avc1394_transaction_... functions. */
+avc1394_pending *
+avc1394_vcr_control_start(raw1394handle_t handle, nodeid_t node,
+	enum avc1394_vcr_operation operation, quadlet_t status, int arg);
+
 #ifdef __cplusplus
 }
 #endif
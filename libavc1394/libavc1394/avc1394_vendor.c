@@ -0,0 +1,145 @@
+/*
+ * libavc1394 - GNU/Linux IEEE 1394 AV/C Library
+ *
+ * avc1394_vendor.c - build and send VENDOR-DEPENDENT commands, and serve
+ * them as a target through handlers registered by company ID.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "avc1394.h"
+#include "avc1394_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the company ID takes the first three operands */
+#define COMPANY_ID_LEN 3
+#define VENDOR_BUCKETS 16
+
+struct vendor_entry {
+	unsigned int company_id;
+	avc1394_vendor_handler_t handler;
+	void *data;
+	struct vendor_entry *next;
+};
+
+static struct vendor_entry *vendor_buckets[VENDOR_BUCKETS];
+
+static unsigned int vendor_hash(unsigned int company_id)
+{
+	return (company_id ^ (company_id >> 12)) % VENDOR_BUCKETS;
+}
+
+int avc1394_vendor_build(avc1394_frame *frame, unsigned char *buffer,
+	unsigned int size, quadlet_t ctype, quadlet_t subunit,
+	unsigned int company_id, const unsigned char *payload, int len)
+{
+	quadlet_t header = ctype | subunit | AVC1394_COMMAND_VENDOR_DEPENDENT;
+
+	if (len < 0 || avc1394_frame_init(frame, buffer, 3, size) < 0
+			|| avc1394_frame_set_operand_count(frame, COMPANY_ID_LEN + len) < 0)
+		return -1;
+	buffer[0] = header >> 24;
+	buffer[1] = header >> 16;
+	buffer[2] = header >> 8;
+	buffer[3] = company_id >> 16;
+	buffer[4] = company_id >> 8;
+	buffer[5] = company_id;
+	if (payload != NULL)
+		memcpy(buffer + 6, payload, len);
+	return 0;
+}
+
+long avc1394_vendor_company_id(const avc1394_frame *frame)
+{
+	unsigned char *id = avc1394_frame_operands(frame, 0, COMPANY_ID_LEN);
+
+	if (avc1394_frame_opcode(frame) != AVC1394_CMD_VENDOR_DEPENDENT || id == NULL)
+		return -1;
+	return ((long) id[0] << 16) | (id[1] << 8) | id[2];
+}
+
+unsigned char *avc1394_vendor_payload(const avc1394_frame *frame, int *len)
+{
+	if (avc1394_vendor_company_id(frame) < 0)
+		return NULL;
+	*len = avc1394_frame_operand_count(frame) - COMPANY_ID_LEN;
+	return avc1394_frame_operands(frame, COMPANY_ID_LEN, *len);
+}
+
+avc1394_pending *avc1394_vendor_start(raw1394handle_t handle, nodeid_t node,
+	quadlet_t ctype, quadlet_t subunit, unsigned int company_id,
+	const unsigned char *payload, int len)
+{
+	quadlet_t buffer[AVC1394_FRAME_MAX / 4];
+	avc1394_frame frame;
+
+	/* built where it is sent from */
+	if (avc1394_vendor_build(&frame, (unsigned char *) buffer, sizeof(buffer),
+			ctype, subunit, company_id, payload, len) < 0)
+		return NULL;
+	while (frame.length % 4)
+		frame.data[frame.length++] = 0;
+	return pending_start_frame(handle, node, buffer, frame.length / 4);
+}
+
+int avc1394_vendor_register(unsigned int company_id,
+	avc1394_vendor_handler_t handler, void *data)
+{
+	struct vendor_entry *e, **link;
+
+	company_id &= 0xFFFFFF;
+	link = &vendor_buckets[vendor_hash(company_id)];
+	for (; (e = *link) != NULL; link = &e->next)
+		if (e->company_id == company_id)
+			break;
+	if (handler == NULL) {
+		if (e != NULL) {
+			*link = e->next;
+			free(e);
+		}
+		return 0;
+	}
+	if (e == NULL) {
+		e = malloc(sizeof(struct vendor_entry));
+		if (e == NULL)
+			return -1;
+		e->company_id = company_id;
+		e->next = NULL;
+		*link = e;
+	}
+	e->handler = handler;
+	e->data = data;
+	return 0;
+}
+
+/*
+ * Serve a VENDOR-DEPENDENT command through the handler of its company.
+ * RETURNS:	what the handler returned, or -1 if no handler takes it.
+ */
+int vendor_dispatch(nodeid_t node, const avc1394_frame *request,
+	avc1394_frame *response)
+{
+	long company_id = avc1394_vendor_company_id(request);
+	struct vendor_entry *e;
+
+	if (company_id < 0)
+		return -1;
+	for (e = vendor_buckets[vendor_hash(company_id)]; e != NULL; e = e->next)
+		if (e->company_id == company_id)
+			return e->handler(node, request, response, e->data);
+	return -1;
+}
@@ -36,6 +36,11 @@
 #define ROM1394_GUID_LO 0x10
 #define ROM1394_ROOT_DIRECTORY 0x14
 
+/* the largest config ROM image, in quadlets */
+#define ROM1394_MAX_SIZE 0x100
+/* attempts of rom1394_publish() when the image keeps changing */
+#define ROM1394_PUBLISH_RETRY 4
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,6 +62,14 @@ typedef struct rom1394_bus_options_struct {
 	int		max_rec;
 } rom1394_bus_options;
 
+typedef struct rom1394_bus_info_struct {
+	int			info_length;	/* of the bus info block, in quadlets */
+	int			crc_length;
+	quadlet_t		bus_id;
+	rom1394_bus_options	bus_options;
+	octlet_t		guid;
+} rom1394_bus_info;
+
 typedef struct rom1394_directory_struct {
 	quadlet_t	node_capabilities;
 	quadlet_t	vendor_id;
@@ -81,9 +94,36 @@ rom1394_get_bus_options(raw1394handle_t handle, nodeid_t node, rom1394_bus_optio
 octlet_t
 rom1394_get_guid(raw1394handle_t handle, nodeid_t node);
 
+/* the config ROM header and the whole bus info block in one read */
+int
+rom1394_get_bus_info(raw1394handle_t handle, nodeid_t node, rom1394_bus_info *info);
+
 int
 rom1394_get_directory(raw1394handle_t handle, nodeid_t node, rom1394_directory *dir);
 
+/* Nodes by GUID, built from only the two GUID quadlets of each node. The
+   GUIDs are read concurrently, and read again on first use after a bus
+   reset. GUIDs of nodes that left the bus are remembered. */
+typedef struct rom1394_guid_index_struct rom1394_guid_index;
+
+rom1394_guid_index *
+rom1394_guid_index_new(raw1394handle_t handle);
+
+void
+rom1394_guid_index_free(rom1394_guid_index *index);
+
+/* read the GUIDs now; returns the number of nodes, or -1 */
+int
+rom1394_guid_index_update(rom1394_guid_index *index);
+
+/* returns the node with guid, or -1 if it is not on the bus */
+int
+rom1394_guid_index_lookup(rom1394_guid_index *index, octlet_t guid);
+
+/* returns the GUID of node, or 0 if unknown */
+octlet_t
+rom1394_guid_index_guid(rom1394_guid_index *index, nodeid_t node);
+
 rom1394_node_types
 rom1394_get_node_type(rom1394_directory *dir);
 
@@ -96,12 +136,57 @@ rom1394_free_directory(rom1394_directory *dir);
 int
 rom1394_get_size(quadlet_t *buffer);
 
+/* textual leaves are replaced in the order rom1394_get_directory() reads
+   them, and may grow */
 int
 rom1394_set_directory(quadlet_t *buffer, rom1394_directory *dir);
 
+/* A leaf for rom1394_add_units(): its quadlets after the length and CRC,
+   in host byte order, e.g. a descriptor leaf */
+typedef struct rom1394_leaf_struct {
+	int		length;
+	quadlet_t	*data;
+} rom1394_leaf;
+
+/* A unit directory for rom1394_add_units(): the spec ID, software version,
+   model ID and textual leaves of dir, followed by any further leaves */
+typedef struct rom1394_unit_struct {
+	rom1394_directory	*dir;
+	int			nr_leaves;
+	rom1394_leaf		*leaves;
+} rom1394_unit;
+
+/* The image functions below lay out the whole image again in one pass,
+   relocating offsets and computing the directory and leaf CRCs. buffer
+   must hold ROM1394_MAX_SIZE quadlets. They return 0, or -1 if the image
+   is invalid or the result would not fit. */
+
+/* add a unit directory with every textual leaf of dir */
 int
 rom1394_add_unit(quadlet_t *buffer, rom1394_directory *dir);
 
+/* add count unit directories */
+int
+rom1394_add_units(quadlet_t *buffer, rom1394_unit *units, int count);
+
+/* returns 0 if the lengths, offsets and CRCs of an image of size quadlets
+   are all consistent, -1 otherwise */
+int
+rom1394_validate(quadlet_t *buffer, int size);
+
+/* changes a config ROM image in place; returns 0, or -1 to give up */
+typedef int (*rom1394_edit_t)(quadlet_t *buffer, void *data);
+
+/* Apply edit to a copy of the local config ROM and publish the result. The
+   header CRC is filled in and the image validated first. If another update
+   gets in first, the edit is applied again to the new image. Nothing is
+   published, and the bus is not reset, when the edit leaves the image as
+   it was. With reset set, the bus is reset after publishing. Returns 1 if
+   published, 0 if unchanged, or -1. */
+int
+rom1394_publish(raw1394handle_t handle, rom1394_edit_t edit, void *data,
+	int reset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,199 @@
+/*
+ * librom1394 - GNU/Linux IEEE 1394 CSR Config ROM Library
+ *
+ * rom1394_guid.c - find nodes by GUID from an index built of just the GUID
+ * quadlets of each node, read concurrently and kept across bus resets.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "rom1394.h"
+#include "rom1394_internal.h"
+#include "../common/raw1394util.h"
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* a bus has at most 63 nodes */
+#define GUID_NODES 64
+#define GUID_BUCKETS 128
+
+struct guid_entry {
+	octlet_t guid;
+	int node;		/* -1 while the node is off the bus */
+	struct guid_entry *next;
+};
+
+/* one node's outstanding GUID read */
+struct guid_read {
+	quadlet_t data[2];
+	int done;
+	int failed;
+};
+
+struct rom1394_guid_index_struct {
+	raw1394handle_t handle;
+	unsigned int generation;
+	int valid;
+	int nodecount;
+	struct guid_entry *nodes[GUID_NODES];
+	struct guid_entry *buckets[GUID_BUCKETS];
+};
+
+static unsigned int guid_hash(octlet_t guid)
+{
+	return (unsigned int) ((guid ^ (guid >> 29)) * 0x9E3779B1u) % GUID_BUCKETS;
+}
+
+static int guid_read_done(raw1394handle_t handle, unsigned long tag,
+	raw1394_errcode_t err)
+{
+	struct guid_read *r = (struct guid_read *) tag;
+
+	r->done = 1;
+	r->failed = raw1394_errcode_to_errno(err) != 0;
+	return 0;
+}
+
+/* the entry for guid, added if it is new */
+static struct guid_entry *guid_entry(rom1394_guid_index *index, octlet_t guid)
+{
+	struct guid_entry *e, **bucket = &index->buckets[guid_hash(guid)];
+
+	for (e = *bucket; e != NULL; e = e->next)
+		if (e->guid == guid)
+			return e;
+	e = malloc(sizeof(struct guid_entry));
+	if (e == NULL)
+		return NULL;
+	e->guid = guid;
+	e->node = -1;
+	e->next = *bucket;
+	*bucket = e;
+	return e;
+}
+
+rom1394_guid_index *rom1394_guid_index_new(raw1394handle_t handle)
+{
+	rom1394_guid_index *index = calloc(1, sizeof(rom1394_guid_index));
+
+	if (index != NULL)
+		index->handle = handle;
+	return index;
+}
+
+void rom1394_guid_index_free(rom1394_guid_index *index)
+{
+	struct guid_entry *e;
+	int i;
+
+	for (i = 0; i < GUID_BUCKETS; i++)
+		while ((e = index->buckets[i]) != NULL) {
+			index->buckets[i] = e->next;
+			free(e);
+		}
+	free(index);
+}
+
+int rom1394_guid_index_update(rom1394_guid_index *index)
+{
+	struct guid_read reads[GUID_NODES];
+	tag_handler_t old_handler;
+	octlet_t offset = CSR_REGISTER_BASE + CSR_CONFIG_ROM + ROM1394_GUID_HI;
+	struct guid_entry *e;
+	int i, n, outstanding = 0, broken = 0;
+
+	/* node IDs are only good for the generation they were read in */
+	index->generation = raw1394_get_generation(index->handle);
+	n = raw1394_get_nodecount(index->handle);
+	if (n < 0 || n > GUID_NODES)
+		return -1;
+
+	old_handler = raw1394_set_tag_handler(index->handle, guid_read_done);
+	for (i = 0; i < n; i++) {
+		reads[i].done = reads[i].failed = 0;
+		if (raw1394_start_read(index->handle, (nodeid_t) 0xffc0 | i,
+				offset, sizeof(reads[i].data), reads[i].data,
+				(unsigned long) &reads[i]) < 0)
+			reads[i].done = reads[i].failed = 1;
+		else
+			outstanding++;
+	}
+	/* the reads started write into reads[] and carry it as their tag, so
+	   all of them have to finish before it goes, even after an error */
+	while (outstanding > 0) {
+		if (raw1394_loop_iterate(index->handle) < 0)
+			broken = 1;
+		for (outstanding = 0, i = 0; i < n; i++)
+			outstanding += !reads[i].done;
+	}
+	raw1394_set_tag_handler(index->handle, old_handler);
+	if (broken)
+		return -1;
+
+	/* entries stay for nodes that left, so they can be found again */
+	for (i = 0; i < index->nodecount; i++)
+		if (index->nodes[i] != NULL)
+			index->nodes[i]->node = -1;
+	for (i = 0; i < n; i++) {
+		index->nodes[i] = NULL;
+		/* retried quadlet by quadlet, as for nodes that refuse block reads */
+		if (reads[i].failed
+				&& (cooked1394_read(index->handle, (nodeid_t) 0xffc0 | i,
+					offset, sizeof(quadlet_t), &reads[i].data[0]) < 0
+				|| cooked1394_read(index->handle, (nodeid_t) 0xffc0 | i,
+					offset + 4, sizeof(quadlet_t), &reads[i].data[1]) < 0)) {
+			DEBUG(i, "GUID read failed");
+			continue;
+		}
+		e = guid_entry(index, ((octlet_t) ntohl(reads[i].data[0]) << 32)
+			| ntohl(reads[i].data[1]));
+		if (e == NULL)
+			continue;
+		e->node = i;
+		index->nodes[i] = e;
+	}
+	index->nodecount = n;
+	index->valid = 1;
+	return n;
+}
+
+/* update only when the bus has been reset since */
+static int index_current(rom1394_guid_index *index)
+{
+	if (index->valid && raw1394_get_generation(index->handle) == index->generation)
+		return 0;
+	return rom1394_guid_index_update(index) < 0 ? -1 : 0;
+}
+
+int rom1394_guid_index_lookup(rom1394_guid_index *index, octlet_t guid)
+{
+	struct guid_entry *e;
+
+	if (index_current(index) < 0)
+		return -1;
+	for (e = index->buckets[guid_hash(guid)]; e != NULL; e = e->next)
+		if (e->guid == guid)
+			return e->node;
+	return -1;
+}
+
+octlet_t rom1394_guid_index_guid(rom1394_guid_index *index, nodeid_t node)
+{
+	if (index_current(index) < 0 || node >= index->nodecount
+			|| index->nodes[node] == NULL)
+		return 0;
+	return index->nodes[node]->guid;
+}
@@ -207,110 +207,147 @@ uint16_t make_crc (uint32_t *ptr, int length)
 	return crc;
 }
 
-int set_unit_directory(quadlet_t *buffer, rom1394_directory *dir)
+/* ----------------------------------------------------------------------------
+ * Config ROM images are edited as a tree of blocks and written out again in
+ * one pass by layout_rom(), which places every block after the one that
+ * refers to it, fills in the offsets and computes the CRCs.
+ */
+
+struct rom_block *new_block(int directory, int length)
 {
-	int i, length;
-	quadlet_t *p = buffer;
-	int	key, value;
-	quadlet_t quadlet;
+	struct rom_block *b = calloc(1, sizeof(struct rom_block));
 
-	quadlet = ntohl(*p);
-	length = quadlet >> 16;
+	if (b == NULL)
+		return NULL;
+	b->directory = directory;
+	b->length = length;
+	b->data = calloc(length > 0 ? length : 1, sizeof(quadlet_t));
+	if (directory)
+		b->children = calloc(length > 0 ? length : 1, sizeof(struct rom_block *));
+	if (b->data == NULL || (directory && b->children == NULL)) {
+		free_block(b);
+		return NULL;
+	}
+	return b;
+}
 
-	DEBUG(-1, "directory has %d entries\n", length);
-	for (i=0; i < length; i++) {
-		p++;
-		quadlet = ntohl(*p);
-		key = quadlet >> 24;
-   		value = quadlet & 0x00FFFFFF;
-		DEBUG(-1, "key/value: %08x/%08x\n", key, value);
-		
-		switch (key) {
-			case 0x12:
-				if (dir->unit_spec_id != -1)
-				{
-					value = (key << 24) | (dir->unit_spec_id & 0x00FFFFFF);
-					*p = htonl(value);
-				}
-				break;
-			case 0x13:
-				if (dir->unit_sw_version != -1)
-				{
-					value = (key << 24) | (dir->unit_sw_version & 0x00FFFFFF);
-					*p = htonl(value);
-				}
-				break;
-			case 0x81:
-			case 0x82:
-				// TODO: unit textual leaves.
-				//if (n < dir->nr_textual_leaves)
-				//	set_textual_leaf( p + value, dir->textual_leaves[n++]);
-				break;
+void free_block(struct rom_block *b)
+{
+	int i;
+
+	if (b == NULL)
+		return;
+	for (i = 0; b->children != NULL && i < b->length; i++)
+		free_block(b->children[i]);
+	free(b->children);
+	free(b->data);
+	free(b);
+}
+
+/* the directory or leaf at index of an image in network byte order;
+   depth guards against offset loops */
+struct rom_block *parse_block(quadlet_t *buffer, int size, int index,
+	int directory, int depth)
+{
+	struct rom_block *b;
+	int i, key, value, length;
+
+	if (index >= size || depth > 8)
+		return NULL;
+	length = ntohl(buffer[index]) >> 16;
+	if (index + length >= size || (b = new_block(directory, length)) == NULL)
+		return NULL;
+	for (i = 0; i < length; i++) {
+		b->data[i] = ntohl(buffer[index + 1 + i]);
+		key = b->data[i] >> 24;
+		value = b->data[i] & 0x00FFFFFF;
+		/* key type 2 is a leaf, 3 a directory */
+		if (!directory || (key >> 6) < 2 || value == 0)
+			continue;
+		b->children[i] = parse_block(buffer, size, index + 1 + i + value,
+			(key >> 6) == 3, depth + 1);
+		if (b->children[i] == NULL) {
+			free_block(b);
+			return NULL;
 		}
 	}
-	
-	/* compute CRC for unit */
-	p = buffer;
-	quadlet = (length << 16);
-	quadlet |= make_crc(p + 1, length) & 0x0000FFFF;
-	*p = htonl(quadlet);
+	return b;
+}
 
+/* append an entry, with the block it refers to if any */
+int append_entry(struct rom_block *dir, quadlet_t entry, struct rom_block *child)
+{
+	quadlet_t *data = realloc(dir->data, (dir->length + 1) * sizeof(quadlet_t));
+	struct rom_block **children;
+
+	if (data == NULL)
+		return -1;
+	dir->data = data;
+	children = realloc(dir->children, (dir->length + 1) * sizeof(struct rom_block *));
+	if (children == NULL)
+		return -1;
+	dir->children = children;
+	dir->data[dir->length] = entry;
+	dir->children[dir->length] = child;
+	dir->length++;
 	return 0;
 }
 
-/* currently does not extend length of textual leaf */
-int
-set_textual_leaf(quadlet_t *buffer, const char *s)
+/* a minimal ASCII textual descriptor leaf of any length */
+struct rom_block *textual_leaf(const char *s)
 {
-	int i, length;
-	quadlet_t *p = buffer, *q = (quadlet_t*)s;
-	quadlet_t quadlet;
-	int n_q; /* number of existing quadlets */
-	
-	quadlet = ntohl(*p);
-	n_q = quadlet >> 16;
-	
-	/* set to simple ascii */
-	p++; *p++ = 0; *p++ = 0;
-	
-	length = (strlen(s) + 3) /4;
-	for (i = 0; i < length && i < n_q-2; i++)
-		*p++ = q[i];
-	
-	/* compute CRC for leaf */
-	p = buffer;
-	quadlet = (n_q << 16);
-	quadlet |= make_crc(p + 1, n_q) & 0x0000FFFF;
-	*p = htonl(quadlet);
-	
-	return 0;
+	int i, n = strlen(s);
+	struct rom_block *b = new_block(0, 2 + (n + 3) / 4);
+
+	if (b == NULL)
+		return NULL;
+	/* descriptor type, specifier, width, character set and language are
+	   all 0, leaving the text zero padded */
+	for (i = 0; i < n; i++)
+		b->data[2 + i / 4] |= (unsigned char) s[i] << (24 - (i % 4) * 8);
+	return b;
 }
 
-/* make sure buffer is pointing to the end of the current rom image! */
-/* returns the number of new quadlets */
-int
-add_textual_leaf(quadlet_t *buffer, const char *s)
+/* 1 if b is a minimal ASCII textual descriptor leaf */
+int is_textual_leaf(struct rom_block *b)
 {
-	int i, length;
-	quadlet_t *p = buffer, *q = (quadlet_t*) s;
-	quadlet_t quadlet;
-	int n_q = 3; /* number of quadlets added */
+	return !b->directory && b->length >= 2 && b->data[0] == 0 && b->data[1] == 0;
+}
 
-	/* set to simple ascii */
-	p++; *p++ = 0; *p++ = 0;
-	
-	length = (strlen(s) + 3) /4;
-	n_q += length;
-	for (i = 0; i < length; i++)
-		*p++ = q[i];
-	
-	/* compute CRC for leaf */
-	p = buffer;
-	quadlet = ((n_q-1) << 16);
-	quadlet |= make_crc(p + 1, n_q-1) & 0x0000FFFF;
-	*p = htonl(quadlet);
+static int place_block(struct rom_block *b, quadlet_t *out, int at, int *end)
+{
+	quadlet_t entry;
+	int i, child;
+
+	if (at + 1 + b->length > ROM1394_MAX_SIZE)
+		return -1;
+	*end = at + 1 + b->length;
+	for (i = 0; i < b->length; i++) {
+		entry = b->data[i];
+		if (b->directory && b->children[i] != NULL) {
+			child = *end;
+			if (place_block(b->children[i], out, child, end) < 0)
+				return -1;
+			entry = (entry & 0xFF000000) | ((child - (at + 1 + i)) & 0x00FFFFFF);
+		}
+		out[at + 1 + i] = htonl(entry);
+	}
+	out[at] = htonl((b->length << 16) | make_crc(out + at + 1, b->length));
+	return 0;
+}
 
-	return n_q;
+/* write root and everything below it after the bus info block of buffer;
+   returns the new image size in quadlets, or -1 if it does not fit */
+int layout_rom(quadlet_t *buffer, struct rom_block *root)
+{
+	quadlet_t out[ROM1394_MAX_SIZE];
+	int end = ROM1394_ROOT_DIRECTORY/4;
+
+	memcpy(out, buffer, ROM1394_ROOT_DIRECTORY);
+	if (place_block(root, out, ROM1394_ROOT_DIRECTORY/4, &end) < 0)
+		return -1;
+	memcpy(buffer, out, end * sizeof(quadlet_t));
+	return end;
 }
 
 int get_leaf_size(quadlet_t *buffer)
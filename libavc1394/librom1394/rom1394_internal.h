@@ -29,7 +29,7 @@
 #include "rom1394.h"
 
 #define QUADINC(x) x+=4
-#define WARN(node, s, addr) fprintf(stderr,"rom1394_%u warning: %s: 0x%08x%08x\n", node, s, (int) (addr>>32), (int) addr)
+#define WARN(node, s, addr) fprintf(stderr,"rom1394_%u warning: %s: 0x%08x%08x\n", node, s, (int) ((addr)>>32), (int) (addr))
 #define QUADREADERR(handle, node, offset, buf) if(cooked1394_read(handle, (nodeid_t) 0xffc0 | node, (nodeaddr_t) offset, (size_t) sizeof(quadlet_t), (quadlet_t *) buf) < 0) WARN(node, "read failed", offset);
 #define FAIL(node, s) {fprintf(stderr, "rom1394_%i error: %s\n", node, s);return(-1);}
 #define NODECHECK(handle, node) \
@@ -52,14 +52,34 @@ proc_directory (raw1394handle_t handle, nodeid_t node, octlet_t offset,
 uint16_t
 make_crc (uint32_t *ptr, int length);
 
+/* a directory or leaf of a config ROM image being edited */
+struct rom_block {
+	int directory;
+	int length;			/* quadlets after the length and CRC */
+	quadlet_t *data;		/* in host byte order */
+	struct rom_block **children;	/* blocks the entries of a directory refer to */
+};
+
+struct rom_block *
+new_block(int directory, int length);
+
+void
+free_block(struct rom_block *b);
+
+struct rom_block *
+parse_block(quadlet_t *buffer, int size, int index, int directory, int depth);
+
 int
-set_unit_directory(quadlet_t *buffer, rom1394_directory *dir);
+append_entry(struct rom_block *dir, quadlet_t entry, struct rom_block *child);
+
+struct rom_block *
+textual_leaf(const char *s);
 
 int
-set_textual_leaf(quadlet_t *buffer, const char *s);
+is_textual_leaf(struct rom_block *b);
 
 int
-add_textual_leaf(quadlet_t *buffer, const char *s);
+layout_rom(quadlet_t *buffer, struct rom_block *root);
 
 int
 get_leaf_size(quadlet_t *buffer);
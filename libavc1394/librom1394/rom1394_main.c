@@ -30,7 +30,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
-#include <math.h>
 
 #define MAXLINE 80
 #define MAX_OFFSETS	256
@@ -66,6 +65,17 @@ quadlet_t rom1394_get_bus_id(raw1394handle_t handle, nodeid_t node)
     return quadlet;
 }
 
+static void decode_bus_options(quadlet_t quadlet, rom1394_bus_options* bus_options)
+{
+	bus_options->irmc = quadlet >> 31;
+	bus_options->cmc = (quadlet >> 30) & 1;
+	bus_options->isc = (quadlet >> 29) & 1;
+	bus_options->bmc = (quadlet >> 28) & 1;
+	bus_options->cyc_clk_acc = (quadlet >> 16) & 0xFF;
+	/* 2^(max_rec+1) bytes */
+	bus_options->max_rec = 2 << ((quadlet >> 12) & 0xF);
+}
+
 int rom1394_get_bus_options(raw1394handle_t handle, nodeid_t node, rom1394_bus_options* bus_options)
 {
 	quadlet_t 	quadlet;
@@ -75,13 +85,7 @@ int rom1394_get_bus_options(raw1394handle_t handle, nodeid_t node, rom1394_bus_o
 	offset = CSR_REGISTER_BASE + CSR_CONFIG_ROM + ROM1394_BUS_OPTIONS;
 	QUADREADERR (handle, node, offset, &quadlet);
 	quadlet = htonl (quadlet);
-	bus_options->irmc = quadlet >> 31;
-	bus_options->cmc = (quadlet >> 30) & 1;
-	bus_options->isc = (quadlet >> 29) & 1;
-	bus_options->bmc = (quadlet >> 28) & 1;
-	bus_options->cyc_clk_acc = (quadlet >> 16) & 0xFF;
-	bus_options->max_rec = (quadlet >> 12) & 0xF;
-	bus_options->max_rec = pow( 2, bus_options->max_rec+1);
+	decode_bus_options(quadlet, bus_options);
 	return 0;
 }
 
@@ -105,6 +109,41 @@ octlet_t rom1394_get_guid(raw1394handle_t handle, nodeid_t node)
     return guid;
 }
 
+int rom1394_get_bus_info(raw1394handle_t handle, nodeid_t node, rom1394_bus_info *info)
+{
+	quadlet_t 	block[ROM1394_ROOT_DIRECTORY/4];
+	octlet_t 	offset;
+	int 		i;
+
+	NODECHECK(handle, node);
+	offset = CSR_REGISTER_BASE + CSR_CONFIG_ROM + ROM1394_HEADER;
+	if (cooked1394_read(handle, (nodeid_t) 0xffc0 | node, (nodeaddr_t) offset,
+			sizeof(block), block) < 0) {
+		/* some old nodes only answer quadlet reads in config ROM */
+		for (i = 0; i < ROM1394_ROOT_DIRECTORY/4; i++, QUADINC(offset))
+			if (cooked1394_read(handle, (nodeid_t) 0xffc0 | node,
+					(nodeaddr_t) offset, sizeof(quadlet_t), &block[i]) < 0) {
+				WARN (node, "read failed", offset);
+				return -1;
+			}
+	}
+	for (i = 0; i < ROM1394_ROOT_DIRECTORY/4; i++)
+		block[i] = ntohl (block[i]);
+
+	info->info_length = block[ROM1394_HEADER/4] >> 24;
+	info->crc_length = (block[ROM1394_HEADER/4] >> 16) & 0xFF;
+	info->bus_id = block[ROM1394_BUS_ID/4];
+	decode_bus_options(block[ROM1394_BUS_OPTIONS/4], &info->bus_options);
+	info->guid = ((octlet_t) block[ROM1394_GUID_HI/4] << 32) | block[ROM1394_GUID_LO/4];
+
+	offset = CSR_REGISTER_BASE + CSR_CONFIG_ROM;
+	if (info->info_length != 4)
+		WARN (node, "wrong bus info block length", offset + ROM1394_HEADER);
+	if (info->bus_id != 0x31333934)
+		WARN (node, "invalid bus id", offset + ROM1394_BUS_ID);
+	return 0;
+}
+
 int rom1394_get_directory(raw1394handle_t handle, nodeid_t node, rom1394_directory *dir)
 {
 	octlet_t 	offset;
@@ -213,151 +252,269 @@ int rom1394_get_size(quadlet_t *buffer)
 }
 
 
-int rom1394_add_unit(quadlet_t *buffer, rom1394_directory *dir)
-{	
-	int i, length;
-	quadlet_t *p = buffer + ROM1394_ROOT_DIRECTORY/4;
-	int	key, value;
-	quadlet_t quadlet;
-	int offset;
-	int n_q = 5; /* number of additional quadlets to add */
-	int len = rom1394_get_size( buffer);
-	
-	if (dir->nr_textual_leafs > 0)
-		n_q++; /* we only support one textual leaf per unit */
-	
-	/* get root dir length and move p to after root dir */
-	quadlet = ntohl(*p);
-	length = quadlet >> 16;
-	p += length + 1;
-	
-	/* get the difference between current position and beginning */
-	offset = (p - buffer);
-	
-	/* move the rest down */
-	/* size = original length minus offset */
-	memmove( p+n_q, p, (len-offset) * sizeof(quadlet_t) );
-	len += n_q;
-	
-	/* reset p to beginning of root */
-	p = buffer + ROM1394_ROOT_DIRECTORY/4;
-	
-	/* adjust offsets in root dir */
-	for (i=0; i < length; i++) {
-		p++;
-		quadlet = ntohl(*p);
-		key = quadlet >> 24;
-		value = quadlet & 0x00FFFFFF;
-		DEBUG(-1, "key/value: %08x/%08x\n", key, value);
-		
-		switch (key) {
-			case 0xD1: // Unit directory
-			case 0x81: // textual leaves
-			case 0x82:
-				value = (key << 24) | ((value + n_q) & 0x00FFFFFF);
-				*p = htonl(value);
-				break;
-		}
+/* the unit directory for a unit, with its textual and descriptor leaves */
+static struct rom_block *unit_block(rom1394_unit *unit)
+{
+	rom1394_directory *dir = unit->dir;
+	struct rom_block *b = new_block(1, 3), *leaf;
+	int i;
+
+	if (b == NULL)
+		return NULL;
+	b->data[0] = (0x12 << 24) | (dir->unit_spec_id & 0x00FFFFFF);
+	b->data[1] = (0x13 << 24) | (dir->unit_sw_version & 0x00FFFFFF);
+	b->data[2] = (0x17 << 24) | (dir->model_id & 0x00FFFFFF);
+
+	/* each leaf describes the model, as the entry before them */
+	for (i = 0; i < dir->nr_textual_leafs; i++) {
+		if (dir->textual_leafs[i] == NULL)
+			continue;
+		if ((leaf = textual_leaf(dir->textual_leafs[i])) == NULL
+				|| append_entry(b, 0x81 << 24, leaf) < 0)
+			goto fail;
 	}
-	
-	/* add unit directory entry to root */
-	p++;
-	value = (0xD1 << 24) | 1;
-	*p++ = htonl(value);
-	
-	/* make new unit directory */
-	p++;
-	value = (0x12 << 24) | (dir->unit_spec_id & 0x00FFFFFF);
-	*p++ = htonl(value);
-	value = (0x13 << 24) | (dir->unit_sw_version & 0x00FFFFFF);
-	*p++ = htonl(value);
-	value = (0x17 << 24) | (dir->model_id & 0x00FFFFFF);
-	*p++ = htonl(value);
-    
-    /* TODO: process multiple leafs */
-	for (i = 0; i < 1 /* dir->nr_textual_leafs */; i++)
-	{
-		value = (0x81 << 24) | (((buffer+len)-p) & 0x00FFFFFF);
-		*p++ = htonl(value);
-		len += add_textual_leaf( buffer + len, dir->textual_leafs[i]);
+	for (i = 0; i < unit->nr_leaves; i++) {
+		if ((leaf = new_block(0, unit->leaves[i].length)) == NULL)
+			goto fail;
+		memcpy(leaf->data, unit->leaves[i].data,
+			unit->leaves[i].length * sizeof(quadlet_t));
+		if (append_entry(b, 0x81 << 24, leaf) < 0)
+			goto fail;
 	}
-	
-	/* compute CRC for unit directory */
-	p = buffer + offset + 1;
-	quadlet = ((n_q-2) << 16);
-	quadlet |= make_crc(p + 1, n_q-2) & 0x0000FFFF;
-	*p = htonl(quadlet);
-	
-	/* increment root directory length */
-	length++;
-	
-	/* compute CRC for root */
-	p = buffer + ROM1394_ROOT_DIRECTORY/4;
-	quadlet = (length << 16);
-	quadlet |= make_crc(p + 1, length) & 0x0000FFFF;
-	*p = htonl(quadlet);
+	return b;
 
-	return 0;
+fail:
+	free_block(leaf);
+	free_block(b);
+	return NULL;
 }
 
+int rom1394_add_units(quadlet_t *buffer, rom1394_unit *units, int count)
+{
+	struct rom_block *root, *unit;
+	int i, result = -1;
 
-int rom1394_set_directory(quadlet_t *buffer, rom1394_directory *dir)
+	root = parse_block(buffer, ROM1394_MAX_SIZE, ROM1394_ROOT_DIRECTORY/4, 1, 0);
+	if (root == NULL)
+		FAIL(-1, "invalid root directory");
+	for (i = 0; i < count; i++) {
+		if ((unit = unit_block(&units[i])) == NULL)
+			goto out;
+		if (append_entry(root, 0xD1 << 24, unit) < 0) {
+			free_block(unit);
+			goto out;
+		}
+	}
+	if (layout_rom(buffer, root) > 0)
+		result = 0;
+	else
+		WARN(-1, "config ROM image too large", (octlet_t) CSR_CONFIG_ROM);
+out:
+	free_block(root);
+	return result;
+}
+
+int rom1394_add_unit(quadlet_t *buffer, rom1394_directory *dir)
 {
-	int i, length;
-	quadlet_t *p = buffer + ROM1394_ROOT_DIRECTORY/4;
-	int	key, value;
-	quadlet_t quadlet;
-	int n = 0; /* iterator thru textual leaves */
+	rom1394_unit unit;
 
-	quadlet = ntohl(*p);
-	length = quadlet >> 16;
-    
-	DEBUG(-1, "directory has %d entries\n", length);
-	for (i=0; i < length; i++) {
-		p++;
-		quadlet = ntohl(*p);
-		key = quadlet >> 24;
-   		value = quadlet & 0x00FFFFFF;
-		DEBUG(-1, "key/value: %08x/%08x\n", key, value);
-		
+	unit.dir = dir;
+	unit.nr_leaves = 0;
+	unit.leaves = NULL;
+	return rom1394_add_units(buffer, &unit, 1);
+}
+
+/* update the entries of a directory and, in the order rom1394_get_directory()
+   reads them, its textual leaves and those of its subdirectories */
+static int set_block(struct rom_block *b, rom1394_directory *dir, int root,
+	int unit, int *n)
+{
+	int i, key;
+	quadlet_t value;
+	struct rom_block *leaf;
+
+	for (i = 0; i < b->length; i++) {
+		key = b->data[i] >> 24;
+		value = -1;
 		switch (key) {
 			case 0x03:
-				if (dir->vendor_id != -1)
-				{
-					value = (key << 24) | (dir->vendor_id & 0x00FFFFFF);
-					*p = htonl(value);
-				}
+				if (root)
+					value = dir->vendor_id;
 				break;
 			case 0x17:
-				if (dir->model_id != -1)
-				{
-					value = (key << 24) | (dir->model_id & 0x00FFFFFF);
-					*p = htonl(value);
-				}
+				if (root)
+					value = dir->model_id;
 				break;
 			case 0x0C:
-				if (dir->node_capabilities != -1)
-				{
-					value = (key << 24) | (dir->node_capabilities & 0x00FFFFFF);
-					*p = htonl(value);
-				}
+				if (root)
+					value = dir->node_capabilities;
+				break;
+			case 0x12:
+				if (unit)
+					value = dir->unit_spec_id;
+				break;
+			case 0x13:
+				if (unit)
+					value = dir->unit_sw_version;
 				break;
-   			case 0xD1: // Unit directory
-				/* update existing unit directory only */
-				set_unit_directory( p + value, dir);
 			case 0x81:
 			case 0x82:
-				if (n < dir->nr_textual_leafs)
-					set_textual_leaf( p + value, dir->textual_leafs[n++]);
+				if (b->children[i] == NULL || *n >= dir->nr_textual_leafs)
+					break;
+				/* leaves that are not plain text keep their place */
+				if (dir->textual_leafs[*n] != NULL
+						&& is_textual_leaf(b->children[i])) {
+					if ((leaf = textual_leaf(dir->textual_leafs[*n])) == NULL)
+						return -1;
+					free_block(b->children[i]);
+					b->children[i] = leaf;
+				}
+				(*n)++;
+				break;
+			case 0xC1:
+			case 0xC3:
+			case 0xC7:
+			case 0xD1:
+			case 0xD4:
+			case 0xD8:
+				if (b->children[i] != NULL && set_block(b->children[i], dir,
+						0, key == 0xD1, n) < 0)
+					return -1;
 				break;
 		}
+		if (value != (quadlet_t) -1)
+			b->data[i] = (key << 24) | (value & 0x00FFFFFF);
 	}
-	
-	/* compute CRC for root */
-	p = buffer + ROM1394_ROOT_DIRECTORY/4;
-	quadlet = (length << 16);
-	quadlet |= make_crc(p + 1, length) & 0x0000FFFF;
-	*p = htonl(quadlet);
+	return 0;
+}
+
+int rom1394_set_directory(quadlet_t *buffer, rom1394_directory *dir)
+{
+	struct rom_block *root;
+	int n = 0, result = -1;
+
+	root = parse_block(buffer, ROM1394_MAX_SIZE, ROM1394_ROOT_DIRECTORY/4, 1, 0);
+	if (root == NULL)
+		FAIL(-1, "invalid root directory");
+	if (set_block(root, dir, 1, 0, &n) == 0 && layout_rom(buffer, root) > 0)
+		result = 0;
+	free_block(root);
+	return result;
+}
+
+
+/****************** PUBLISH CONFIG ROM IMAGE ******************************/
+
+/* check a directory or leaf at index and, for a directory, everything it
+   points to, raising *end past each block; without crc only the layout is
+   checked. depth guards against offset loops. */
+static int walk_block(quadlet_t *buffer, int size, int index, int directory,
+	int crc, int depth, int *end)
+{
+	quadlet_t quadlet;
+	int i, length, key, target;
 
+	if (index < 0 || index >= size || depth > 8)
+		return -1;
+	quadlet = ntohl(buffer[index]);
+	length = quadlet >> 16;
+	if (index + length >= size) {
+		DEBUG(-1, "block at %d runs past the image", index);
+		return -1;
+	}
+	if (crc && (quadlet & 0xFFFF) != make_crc(buffer + index + 1, length)) {
+		DEBUG(-1, "bad CRC for block at %d", index);
+		return -1;
+	}
+	if (index + length + 1 > *end)
+		*end = index + length + 1;
+	for (i = 1; directory && i <= length; i++) {
+		quadlet = ntohl(buffer[index + i]);
+		key = quadlet >> 24;
+		target = index + i + (quadlet & 0x00FFFFFF);
+		/* key type 2 is a leaf, 3 a directory */
+		if ((key >> 6) >= 2 && walk_block(buffer, size, target,
+				(key >> 6) == 3, crc, depth + 1, end) < 0)
+			return -1;
+	}
 	return 0;
 }
+
+/* returns 0 if the image of size quadlets is consistent, -1 otherwise */
+int rom1394_validate(quadlet_t *buffer, int size)
+{
+	quadlet_t quadlet;
+	int info_length, crc_length, end = 0;
+
+	if (size <= ROM1394_ROOT_DIRECTORY/4 || size > ROM1394_MAX_SIZE)
+		return -1;
+	quadlet = ntohl(buffer[ROM1394_HEADER/4]);
+	info_length = quadlet >> 24;
+	crc_length = (quadlet >> 16) & 0xFF;
+	if (info_length != 4 || crc_length < info_length || crc_length >= size
+			|| (quadlet & 0xFFFF) != make_crc(buffer + 1, crc_length))
+		return -1;
+	if (ntohl(buffer[ROM1394_BUS_ID/4]) != 0x31333934)
+		return -1;
+	return walk_block(buffer, size, ROM1394_ROOT_DIRECTORY/4, 1, 1, 0, &end);
+}
+
+/* the header CRC is left to here, as a CRC over the whole image changes
+   with every edit */
+static void set_header_crc(quadlet_t *buffer, int size)
+{
+	quadlet_t quadlet = ntohl(buffer[ROM1394_HEADER/4]);
+	int crc_length = (quadlet >> 16) & 0xFF;
+
+	if (crc_length > ROM1394_ROOT_DIRECTORY/4 - 1)
+		crc_length = size - 1;
+	quadlet = (quadlet & 0xFF000000) | (crc_length << 16)
+		| make_crc(buffer + 1, crc_length);
+	buffer[ROM1394_HEADER/4] = htonl(quadlet);
+}
+
+int rom1394_publish(raw1394handle_t handle, rom1394_edit_t edit, void *data,
+	int reset)
+{
+	quadlet_t current[ROM1394_MAX_SIZE], rom[ROM1394_MAX_SIZE];
+	size_t rom_size;
+	unsigned char rom_version;
+	int size, tries, retval;
+
+	for (tries = 0; tries < ROM1394_PUBLISH_RETRY; tries++) {
+		memset(current, 0, sizeof(current));
+		if (raw1394_get_config_rom(handle, current, sizeof(current),
+				&rom_size, &rom_version) < 0)
+			return -1;
+		memcpy(rom, current, sizeof(rom));
+		if (edit(rom, data) < 0)
+			return -1;
+		/* nothing to publish, and no reason to reset the bus */
+		if (memcmp(rom, current, sizeof(rom)) == 0)
+			return 0;
+
+		/* the image ends after its last block, wherever that is */
+		size = 0;
+		if (walk_block(rom, ROM1394_MAX_SIZE, ROM1394_ROOT_DIRECTORY/4, 1, 0, 0,
+				&size) < 0) {
+			FAIL(-1, "edited config ROM is not valid");
+		}
+		set_header_crc(rom, size);
+		if (rom1394_validate(rom, size) < 0) {
+			FAIL(-1, "edited config ROM is not valid");
+		}
+
+		retval = raw1394_update_config_rom(handle, rom,
+			size * sizeof(quadlet_t), rom_version);
+		if (retval == 0) {
+			if (reset)
+				raw1394_reset_bus(handle);
+			return 1;
+		}
+		/* -2 means another update got in first: edit the new image */
+		if (retval != -2)
+			return -1;
+		DEBUG(-1, "config ROM changed underneath, retrying");
+	}
+	FAIL(-1, "config ROM kept changing during update");
+}
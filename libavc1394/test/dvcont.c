@@ -37,84 +37,90 @@
 #include <libraw1394/raw1394.h>
 #include <libraw1394/csr.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/poll.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
-#define version "Version 0.4"
-
-void show_help() {
-
-printf("\n--- DVCONT HELP ---");
-printf("\n\nUsage: dvcont <command>");
-printf("\n\nCommands:");
-printf("\nplay - Tell the camera to play (or toggle slow-mo)");
-printf("\nreverse - Tell the camera to play in reverse (or toggle reverse slow-mo)");
-printf("\ntrickplay - Tell the camera to play back at -14 to +14 (not supported by all cams)");
-printf("\nstop - Tell the camera to stop");
-printf("\nrewind - Tell the camera to rewind (stop or play mode)");
-printf("\nff - Tell the camera to fast forward (stop or play mode)");
-printf("\npause - Tell the camera to toggle pause play");
-printf("\nnext - Tell the camera to go to the next frame (pause mode)");
-printf("\nnextindex - Tell the camera to go to the next index point and pause");
-printf("\nprev - Tell the camera to go to the previous frame (pause mode)");
-printf("\nprevindex - Tell the camera to go to the previous index point and pause");
-printf("\nrecord - Tell the camera to record (use with caution!)");
-printf("\neject - Tell the camera to eject the tape (awe your friends!)");
-printf("\ntimecode - Report the timecode from the tape (HH:MM:SS:FF)");
-printf("\nseek - Tell the camera to go to the <timecode> (HH:MM:SS:FF)");
-printf("\nstatus - Report the status of the device");
-printf("\npluginfo - Report available plugs");
-printf("\nverbose - Tell the program to tell you debug info.");
-printf("\nversion - Tell the program to tell you the program version.");
-printf("\nhelp - Tell the program to show you this screen");
-printf("\ndev <number> - Select device number on chain to use.");
-printf("\n               (use the dev command BEFORE any other commands)");
-printf("\n\n");
+#define version "Version 0.5"
 
-}
+/* longest request line accepted by the daemon */
+#define MAXLINE 1024
+#define MAXWORDS 64
+/* clients the daemon serves at once */
+#define MAXCLIENTS 8
+/* how long a transport state learned from the device stays trusted */
+#define STATE_TTL 500
 
-int main (int argc, char *argv[])
-{
-	rom1394_directory rom_dir;
+/* everything that outlives a single command in daemon mode */
+struct session {
 	raw1394handle_t handle;
-	int device = -1;
-	int verbose = 0;
-    int i, j;
-	int speed;
-	char timecode[12];
+	int device;
+	int manual_device;	/* chosen with "dev", not discovered */
+	unsigned int generation;	/* of the bus when device was found */
+	quadlet_t state;	/* last known transport state */
+	int state_valid;
+	struct timespec state_time;
+	int verbose;
+};
 
-	if (argc < 2)
-	{
-		show_help();
-		exit(0);
-	}
-	
-#ifdef RAW1394_V_0_8
-	handle = raw1394_get_handle();
-#else
-    handle = raw1394_new_handle();
-#endif
-    if (!handle)
-    {
-        if (!errno)
-        {
-            fprintf(stderr, "Not Compatable!\n");
-        } else {
-            perror("Couldn't get 1394 handle");
-            fprintf(stderr, "Is ieee1394, driver, and raw1394 loaded?\n");
-        }
-        exit(1);
-    } 
+/* a daemon connection and what it has sent of its next request line */
+struct client {
+	int fd;
+	FILE *out;
+	char line[MAXLINE];
+	int len;
+};
 
-	if (raw1394_set_port(handle, 0) < 0) {
-		perror("couldn't set port");
-        raw1394_destroy_handle(handle);
-		exit(1);
-	}
+void show_help(FILE *out) {
 
-		
+fprintf(out, "\n--- DVCONT HELP ---");
+fprintf(out, "\n\nUsage: dvcont <command>");
+fprintf(out, "\n\nCommands:");
+fprintf(out, "\nplay - Tell the camera to play (or toggle slow-mo)");
+fprintf(out, "\nreverse - Tell the camera to play in reverse (or toggle reverse slow-mo)");
+fprintf(out, "\ntrickplay - Tell the camera to play back at -14 to +14 (not supported by all cams)");
+fprintf(out, "\nstop - Tell the camera to stop");
+fprintf(out, "\nrewind - Tell the camera to rewind (stop or play mode)");
+fprintf(out, "\nff - Tell the camera to fast forward (stop or play mode)");
+fprintf(out, "\npause - Tell the camera to toggle pause play");
+fprintf(out, "\nnext - Tell the camera to go to the next frame (pause mode)");
+fprintf(out, "\nnextindex - Tell the camera to go to the next index point and pause");
+fprintf(out, "\nprev - Tell the camera to go to the previous frame (pause mode)");
+fprintf(out, "\nprevindex - Tell the camera to go to the previous index point and pause");
+fprintf(out, "\nrecord - Tell the camera to record (use with caution!)");
+fprintf(out, "\neject - Tell the camera to eject the tape (awe your friends!)");
+fprintf(out, "\ntimecode - Report the timecode from the tape (HH:MM:SS:FF)");
+fprintf(out, "\nseek - Tell the camera to go to the <timecode> (HH:MM:SS:FF)");
+fprintf(out, "\nstatus - Report the status of the device");
+fprintf(out, "\npluginfo - Report available plugs");
+fprintf(out, "\nverbose - Tell the program to tell you debug info.");
+fprintf(out, "\nversion - Tell the program to tell you the program version.");
+fprintf(out, "\nhelp - Tell the program to show you this screen");
+fprintf(out, "\ndev <number> - Select device number on chain to use.");
+fprintf(out, "\n               (use the dev command BEFORE any other commands)");
+fprintf(out, "\ndaemon <socket> - Keep running and take commands from a Unix socket.");
+fprintf(out, "\nsocket <socket> <commands> - Send commands to a running daemon.");
+fprintf(out, "\n               (both must be the first command)");
+fprintf(out, "\n\n");
+
+}
+
+/* find the first AV/C tape recorder on the bus */
+int find_device(struct session *s)
+{
+	rom1394_directory rom_dir;
+	raw1394handle_t handle = s->handle;
+	int i;
+
+	s->generation = raw1394_get_generation(handle);
+	s->state_valid = 0;
    	for (i=0; i < raw1394_get_nodecount(handle); ++i)
     {
     	if (rom1394_get_directory(handle, i, &rom_dir) < 0)
@@ -123,111 +129,184 @@ int main (int argc, char *argv[])
     	    continue;
         }
 
-		for (j = 1; j < argc; ++j) {
-			if (strcmp("verbose", argv[j]) == 0) {
-				printf ("node %d type = %d\n", i, rom1394_get_node_type(&rom_dir));
-				if ( (rom1394_get_node_type(&rom_dir) == ROM1394_NODE_TYPE_AVC) ) {
-					printf ("node %d AVC video recorder? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_TAPE_RECORDER) ? "yes":"no");
-					printf ("node %d AVC disk recorder? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_DISC_RECORDER) ? "yes":"no");
-					printf ("node %d AVC tuner? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_TUNER) ? "yes":"no");
-					printf ("node %d AVC video camera? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_VIDEO_CAMERA) ? "yes":"no");
-					printf ("node %d AVC video monitor? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_VIDEO_MONITOR) ? "yes":"no");
-				}
+		if (s->verbose) {
+			printf ("node %d type = %d\n", i, rom1394_get_node_type(&rom_dir));
+			if ( (rom1394_get_node_type(&rom_dir) == ROM1394_NODE_TYPE_AVC) ) {
+				printf ("node %d AVC video recorder? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_TAPE_RECORDER) ? "yes":"no");
+				printf ("node %d AVC disk recorder? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_DISC_RECORDER) ? "yes":"no");
+				printf ("node %d AVC tuner? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_TUNER) ? "yes":"no");
+				printf ("node %d AVC video camera? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_VIDEO_CAMERA) ? "yes":"no");
+				printf ("node %d AVC video monitor? %s\n", i, avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_VIDEO_MONITOR) ? "yes":"no");
 			}
 		}
 		
         if ( (rom1394_get_node_type(&rom_dir) == ROM1394_NODE_TYPE_AVC) &&
             avc1394_check_subunit_type(handle, i, AVC1394_SUBUNIT_TYPE_VCR))
         {
-            device = i;
-            break;
+            rom1394_free_directory(&rom_dir);
+            s->device = i;
+            return i;
         }
+        rom1394_free_directory(&rom_dir);
     }
-    
-    if (device == -1)
-    {
-        fprintf(stderr, "Could not find any AV/C devices on the 1394 bus.\n");
-        raw1394_destroy_handle(handle);
-        exit(1);
-    }
+    s->device = -1;
+    return -1;
+}
+
+/* the transport state, from the device unless recently learned */
+quadlet_t current_state(struct session *s)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!s->state_valid || (now.tv_sec - s->state_time.tv_sec) * 1000
+			+ (now.tv_nsec - s->state_time.tv_nsec) / 1000000 > STATE_TTL) {
+		s->state = avc1394_vcr_status(s->handle, s->device);
+		s->state_valid = (s->state != (quadlet_t) -1);
+		s->state_time = now;
+	}
+	return s->state;
+}
+
+/* perform a transport operation with one round-trip when the state is known */
+void control(struct session *s, enum avc1394_vcr_operation op, int arg, FILE *out)
+{
+	quadlet_t state = 0, response = 0;
+	int result;
+
+	if (op != AVC1394_VCR_OP_STOP && op != AVC1394_VCR_OP_EJECT
+			&& op != AVC1394_VCR_OP_RECORD)
+		state = current_state(s);
+	result = avc1394_vcr_control(s->handle, s->device, op, state, arg, &response);
+	switch (AVC1394_MASK_OPCODE(response)) {
+	case AVC1394_VCR_RESPONSE_TRANSPORT_STATE_PLAY:
+	case AVC1394_VCR_RESPONSE_TRANSPORT_STATE_RECORD:
+	case AVC1394_VCR_RESPONSE_TRANSPORT_STATE_WIND:
+		if (result == AVC1394_RESP_ACCEPTED) {
+			/* an accepted transport command is the new state */
+			s->state = response;
+			s->state_valid = 1;
+			clock_gettime(CLOCK_MONOTONIC, &s->state_time);
+			break;
+		}
+		/* fall through */
+	default:
+		s->state_valid = 0;
+	}
+	if (result == AVC1394_RESP_REJECTED || result == AVC1394_RESP_NOT_IMPLEMENTED)
+		fprintf(out, "command rejected by device\n");
+	else if (result < 0)
+		fprintf(out, "no response from device\n");
+}
+
+/* run one command line; returns -1 if there is no device to talk to */
+int execute(struct session *s, int argc, char *argv[], FILE *out)
+{
+	raw1394handle_t handle = s->handle;
+	int i;
+	int speed;
+	char timecode[12];
 
-    for (i = 1; i < argc; ++i) {
+	/* node numbers change on bus reset */
+	if (!s->manual_device && (s->device == -1
+			|| s->generation != raw1394_get_generation(handle)))
+		find_device(s);
+
+    for (i = 0; i < argc; ++i) {
+        
+	    if (strcmp("dev", argv[i]) == 0) {
+		
+			if (i+1 < argc) {
+				s->device = atoi(argv[(i+1)]);
+				s->manual_device = 1;
+				s->state_valid = 0;
+			}
+		
+    		if (s->verbose == 1) {
+    			fprintf(out, "\nUsing Device: %d\n", s->device);
+    		}
+			continue;
+
+	    } else if (strcmp("version", argv[i]) == 0) {
+			fprintf(out, "\nDV Camera Console Control Program\n%s\nBy: Jason Howard, Dan Dennedy, and Andreas Micklei\n", version);
+			continue;
+	    
+	    } else if (strcmp("help", argv[i]) == 0) {
+			show_help (out);
+			continue;
+	    }
+
+	    if (s->device == -1)
+	    {
+	        fprintf(stderr, "Could not find any AV/C devices on the 1394 bus.\n");
+	        return -1;
+	    }
         
         if (strcmp("play", argv[i]) == 0) {
-            avc1394_vcr_play(handle, device);
+            control(s, AVC1394_VCR_OP_PLAY, 0, out);
           
 	    } else if (strcmp("reverse", argv[i]) == 0) {
-            avc1394_vcr_reverse(handle, device);
+            control(s, AVC1394_VCR_OP_REVERSE, 0, out);
 	    
 	    } else if (strcmp("trickplay", argv[i]) == 0) {
 	        if (i+1 < argc) {
                 speed = atoi(argv[(i+1)]);
-                avc1394_vcr_trick_play(handle, device, speed);
+                control(s, AVC1394_VCR_OP_TRICK_PLAY, speed, out);
             }
 	    
 	    } else if (strcmp("stop", argv[i]) == 0) {
-            avc1394_vcr_stop(handle, device);
+            control(s, AVC1394_VCR_OP_STOP, 0, out);
 	    
 	    } else if (strcmp("rewind", argv[i]) == 0) {
-    		avc1394_vcr_rewind(handle, device);
+    		control(s, AVC1394_VCR_OP_REWIND, 0, out);
 	    
 	    } else if (strcmp("ff", argv[i]) == 0) {
-    		avc1394_vcr_forward(handle, device);
+    		control(s, AVC1394_VCR_OP_FORWARD, 0, out);
 	    
 	    } else if (strcmp("pause", argv[i]) == 0) {
-		    avc1394_vcr_pause(handle, device);
+		    control(s, AVC1394_VCR_OP_PAUSE, 0, out);
 	    
 	    } else if (strcmp("record", argv[i]) == 0) {
-    		avc1394_vcr_record(handle, device);
+    		control(s, AVC1394_VCR_OP_RECORD, 0, out);
 	    
 	    } else if (strcmp("eject", argv[i]) == 0) {
-    		avc1394_vcr_eject(handle, device);
+    		control(s, AVC1394_VCR_OP_EJECT, 0, out);
 	    
 	    } else if (strcmp("status", argv[i]) == 0) {
-    		printf( "%s\n", avc1394_vcr_decode_status(avc1394_vcr_status(handle, device)));
+    		s->state_valid = 0;
+    		fprintf(out, "%s\n", avc1394_vcr_decode_status(current_state(s)));
 	    
 	    } else if (strcmp("timecode", argv[i]) == 0) {
-	        if (avc1394_vcr_get_timecode2(handle, device, timecode) == 0)
-        		printf( "%s\n", timecode);
+	        if (avc1394_vcr_get_timecode2(handle, s->device, timecode) == 0)
+        		fprintf(out, "%s\n", timecode);
 			else
-				printf( "--:--:--:--\n");
+				fprintf(out, "--:--:--:--\n");
 	    
 	    } else if (strcmp("seek", argv[i]) == 0) {
-	        avc1394_vcr_seek_timecode(handle, device, argv[i+1]);
-	    
-	    } else if (strcmp("version", argv[i]) == 0) {
-			printf("\nDV Camera Console Control Program\n%s\nBy: Jason Howard, Dan Dennedy, and Andreas Micklei\n", version);
+	        if (i+1 < argc) {
+	            avc1394_vcr_seek_timecode(handle, s->device, argv[i+1]);
+	            s->state_valid = 0;
+	        }
 	    
 	    } else if (strcmp("verbose", argv[i]) == 0) {
-			printf("successfully got handle\n");
-			printf("current generation number: %d\n", raw1394_get_generation(handle));
-			printf("using first card found: %d nodes on bus, local ID is %d\n",
+			fprintf(out, "successfully got handle\n");
+			fprintf(out, "current generation number: %d\n", raw1394_get_generation(handle));
+			fprintf(out, "using first card found: %d nodes on bus, local ID is %d\n",
 			raw1394_get_nodecount(handle),
 			raw1394_get_local_id(handle) & 0x3f);
-			verbose = 1;
+			s->verbose = 1;
 
 	    } else if (strcmp("next", argv[i]) == 0) {
-			avc1394_vcr_next(handle, device);
+			control(s, AVC1394_VCR_OP_NEXT, 0, out);
 	    
 	    } else if (strcmp("nextindex", argv[i]) == 0) {
-			avc1394_vcr_next_index(handle, device);
+			control(s, AVC1394_VCR_OP_NEXT_INDEX, 0, out);
 	    
 	    } else if (strcmp("prev", argv[i]) == 0) {
-			avc1394_vcr_previous(handle, device);
+			control(s, AVC1394_VCR_OP_PREVIOUS, 0, out);
 	    
 	    } else if (strcmp("previndex", argv[i]) == 0) {
-			avc1394_vcr_previous_index(handle, device);
-	    
-	    } else if (strcmp("help", argv[i]) == 0) {
-			show_help ();
-	    
-	    } else if (strcmp("dev", argv[i]) == 0) {
-		
-			device = atoi(argv[(i+1)]);
-		
-    		if (verbose == 1) {
-    			printf("\nUsing Device: %d\n", device);
-    		}
+			control(s, AVC1394_VCR_OP_PREVIOUS_INDEX, 0, out);
 
 		} else if (strcmp( "pluginfo", argv[i]) == 0) {
 			quadlet_t  request[2];
@@ -236,12 +315,12 @@ int main (int argc, char *argv[])
 			request[0] = AVC1394_CTYPE_STATUS | AVC1394_SUBUNIT_TYPE_TAPE_RECORDER | AVC1394_SUBUNIT_ID_0
 						 | AVC1394_COMMAND_PLUG_INFO | 0x00;
 			request[1] = 0xFFFFFFFF;
-			response = avc1394_transaction_block(handle, device, request, 2, 2);
+			response = avc1394_transaction_block(handle, s->device, request, 2, 2);
 			if (response != NULL) {
-				printf("serial bus input plugs = %d\n", (unsigned char) ((response[1]>>24) & 0xff));
-				printf("serial bus output plugs = %d\n", (unsigned char) ((response[1]>>16) & 0xff));
-				printf("external input plugs = %d\n", (unsigned char) ((response[1]>>8) & 0xff));
-				printf("external output plugs = %d\n", (unsigned char) ((response[1]) & 0xff));
+				fprintf(out, "serial bus input plugs = %d\n", (unsigned char) ((response[1]>>24) & 0xff));
+				fprintf(out, "serial bus output plugs = %d\n", (unsigned char) ((response[1]>>16) & 0xff));
+				fprintf(out, "external input plugs = %d\n", (unsigned char) ((response[1]>>8) & 0xff));
+				fprintf(out, "external output plugs = %d\n", (unsigned char) ((response[1]) & 0xff));
 #ifdef DEBUG
 				fprintf(stderr, "pluginfo: 0x%08X 0x%08X\n", response[0], response[1]);
 #endif
@@ -249,7 +328,225 @@ int main (int argc, char *argv[])
 			avc1394_transaction_block_close(handle);
 		}
 	}
+	return 0;
+}
+
+/*
+ * Daemon mode. The protocol is line based: each request is a line of
+ * commands as they would be given on the command line, and the reply is
+ * whatever the commands print followed by a line with "OK" or "ERROR".
+ * Clients are served together, a request line at a time as it arrives.
+ */
+int open_socket(const char *path, struct sockaddr_un *addr)
+{
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+	return fd;
+}
+
+int split_words(char *line, char *words[])
+{
+	int n = 0;
+	char *w;
+
+	for (w = strtok(line, " \t\r\n"); w != NULL && n < MAXWORDS;
+			w = strtok(NULL, " \t\r\n"))
+		words[n++] = w;
+	return n;
+}
+
+void close_client(struct client *c)
+{
+	fclose(c->out);
+	close(c->fd);
+	c->fd = -1;
+}
+
+/* read what the client has sent and run the complete request lines in it;
+   returns -1 once the client is to be closed */
+int serve_client(struct session *s, struct client *c)
+{
+	char *words[MAXWORDS];
+	char *end;
+	int n;
+
+	n = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+	if (n <= 0)
+		return (n < 0 && errno == EINTR) ? 0 : -1;
+	c->len += n;
+	c->line[c->len] = '\0';
+	while ((end = strchr(c->line, '\n')) != NULL) {
+		*end++ = '\0';
+		n = split_words(c->line, words);
+		if (n > 0 && execute(s, n, words, c->out) < 0)
+			fprintf(c->out, "ERROR\n");
+		else
+			fprintf(c->out, "OK\n");
+		fflush(c->out);
+		c->len -= end - c->line;
+		memmove(c->line, end, c->len + 1);
+	}
+	/* a request too long to ever complete */
+	return c->len < (int) sizeof(c->line) - 1 ? 0 : -1;
+}
+
+int run_daemon(struct session *s, const char *path)
+{
+	struct sockaddr_un addr;
+	struct client clients[MAXCLIENTS];
+	struct pollfd fds[2 + MAXCLIENTS];
+	int listener, fd, i;
+
+	if ((listener = open_socket(path, &addr)) < 0)
+		return 1;
+	unlink(path);
+	if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) < 0
+			|| listen(listener, 8) < 0) {
+		perror("couldn't listen on socket");
+		close(listener);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+	fds[1].fd = raw1394_get_fd(s->handle);
+	fds[1].events = POLLIN;
+	for (i = 0; i < MAXCLIENTS; i++) {
+		clients[i].fd = -1;
+		fds[2 + i].events = POLLIN;
+	}
+	for (;;) {
+		/* poll() skips the free slots, their fd is -1 */
+		for (i = 0; i < MAXCLIENTS; i++)
+			fds[2 + i].fd = clients[i].fd;
+		if (poll(fds, 2 + MAXCLIENTS, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		/* keep the generation current to notice bus resets */
+		if (fds[1].revents & POLLIN)
+			raw1394_loop_iterate(s->handle);
+		for (i = 0; i < MAXCLIENTS; i++) {
+			if (clients[i].fd < 0
+					|| !(fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (serve_client(s, &clients[i]) < 0)
+				close_client(&clients[i]);
+		}
+		if (fds[0].revents & POLLIN) {
+			if ((fd = accept(listener, NULL, NULL)) < 0)
+				continue;
+			for (i = 0; i < MAXCLIENTS && clients[i].fd >= 0; i++)
+				;
+			if (i == MAXCLIENTS
+					|| (clients[i].out = fdopen(dup(fd), "w")) == NULL) {
+				close(fd);
+				continue;
+			}
+			clients[i].fd = fd;
+			clients[i].len = 0;
+		}
+	}
+	for (i = 0; i < MAXCLIENTS; i++)
+		if (clients[i].fd >= 0)
+			close_client(&clients[i]);
+	close(listener);
+	unlink(path);
+	return 1;
+}
+
+int run_client(const char *path, int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	char line[MAXLINE];
+	FILE *io;
+	int fd, i, result = 1;
+
+	if ((fd = open_socket(path, &addr)) < 0)
+		return 1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("couldn't connect to dvcont daemon");
+		close(fd);
+		return 1;
+	}
+	io = fdopen(fd, "r+");
+	for (i = 0; i < argc; i++)
+		fprintf(io, "%s%s", argv[i], i + 1 < argc ? " " : "\n");
+	fflush(io);
+	while (fgets(line, sizeof(line), io) != NULL) {
+		if (strcmp(line, "OK\n") == 0) {
+			result = 0;
+			break;
+		} else if (strcmp(line, "ERROR\n") == 0) {
+			break;
+		}
+		fputs(line, stdout);
+	}
+	fclose(io);
+	return result;
+}
+
+int main (int argc, char *argv[])
+{
+	struct session s;
+	raw1394handle_t handle;
+	int i, result;
+
+	if (argc < 2)
+	{
+		show_help(stdout);
+		exit(0);
+	}
+
+	if (strcmp("socket", argv[1]) == 0 && argc > 2)
+		exit(run_client(argv[2], argc - 3, argv + 3));
+	
+#ifdef RAW1394_V_0_8
+	handle = raw1394_get_handle();
+#else
+    handle = raw1394_new_handle();
+#endif
+    if (!handle)
+    {
+        if (!errno)
+        {
+            fprintf(stderr, "Not Compatable!\n");
+        } else {
+            perror("Couldn't get 1394 handle");
+            fprintf(stderr, "Is ieee1394, driver, and raw1394 loaded?\n");
+        }
+        exit(1);
+    } 
+
+	if (raw1394_set_port(handle, 0) < 0) {
+		perror("couldn't set port");
+        raw1394_destroy_handle(handle);
+		exit(1);
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.handle = handle;
+	s.device = -1;
+	for (i = 1; i < argc; ++i)
+		if (strcmp("verbose", argv[i]) == 0)
+			s.verbose = 1;
+
+	if (strcmp("daemon", argv[1]) == 0 && argc > 2) {
+		find_device(&s);
+		result = run_daemon(&s, argv[2]);
+	} else {
+		result = execute(&s, argc - 1, argv + 1, stdout) < 0 ? 1 : 0;
+	}
 		
     raw1394_destroy_handle(handle);
-	return 0;
+	return result;
 }
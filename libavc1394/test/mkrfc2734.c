@@ -27,13 +27,35 @@ const char not_loaded[] =
 "This probably means that you don't have raw1394 support in the kernel or that\n"
 "you haven't loaded the raw1394 module.\n";
 
+/* RFC 2734 IPv4 over 1394 */
+#define RFC2734_SPEC_ID 0x0000005e
+#define RFC2734_SW_VERSION 0x00000001
+
+/* add the unit directory unless the image already has one */
+static int add_rfc2734_unit(quadlet_t *rom, void *data)
+{
+	quadlet_t *root = rom + ROM1394_ROOT_DIRECTORY/4, *unit;
+	int i, j, length = ntohl(*root) >> 16, found;
+
+	for (i = 1; i <= length; i++) {
+		if (ntohl(root[i]) >> 24 != 0xD1)
+			continue;
+		unit = root + i + (ntohl(root[i]) & 0x00FFFFFF);
+		found = 0;
+		for (j = 1; j <= ntohl(*unit) >> 16; j++)
+			if (ntohl(unit[j]) == ((0x12 << 24) | RFC2734_SPEC_ID)
+					|| ntohl(unit[j]) == ((0x13 << 24) | RFC2734_SW_VERSION))
+				found++;
+		if (found == 2)
+			return 0;
+	}
+	return rom1394_add_unit(rom, data);
+}
+
 int main(int argc, char **argv)
 {
 	raw1394handle_t handle;
 	int retval;
-	quadlet_t rom[0x100];
-	size_t rom_size;
-	unsigned char rom_version;
 	rom1394_directory dir;
 	char *(leaf[2]);
 	
@@ -54,40 +76,23 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 	
-	/* get the current rom image */
-	retval=raw1394_get_config_rom(handle, rom, 0x100, &rom_size, &rom_version);
-	rom_size = rom1394_get_size(rom);
-	printf("get_config_rom returned %d, romsize %d, rom_version %d:",retval,rom_size,rom_version);
-	
-	/* get the local directory */
-	rom1394_get_directory( handle, raw1394_get_local_id(handle) & 0x3f, &dir);
-	
-	/* free the allocated mem for the textual leaves */
-	rom1394_free_directory( &dir);
-	
-	/* add an RFC 2734 unit directory */
-	dir.unit_spec_id    = 0x0000005e;
-	dir.unit_sw_version = 0x00000001;
+	/* an RFC 2734 unit directory */
+	memset(&dir, 0, sizeof(dir));
+	dir.unit_spec_id    = RFC2734_SPEC_ID;
+	dir.unit_sw_version = RFC2734_SW_VERSION;
 	leaf[0] = "IANA";
-    leaf[1] = "IPv4";
+	leaf[1] = "IPv4";
 	dir.nr_textual_leafs = 2;
 	dir.textual_leafs = leaf;
 	
-	/* manipulate the rom */
-	retval = rom1394_add_unit( rom, &dir);
-	
-	/* get the computed size of the rom image */
-	rom_size = rom1394_get_size(rom);
-	
-	printf("rom1394_add_unit_directory returned %d, romsize %d:",retval,rom_size);
-	
-	/* convert computed rom size from quadlets to bytes before update */
-	rom_size *= sizeof(quadlet_t);
-	retval = raw1394_update_config_rom(handle, rom, rom_size, rom_version);
-	printf("update_config_rom returned %d\n",retval);
-	printf("You need to reload your ieee1394 modules to reset the rom.\n");
-    
-    raw1394_reset_bus(handle);
+	/* publish it, resetting the bus only if the rom changed */
+	retval = rom1394_publish(handle, add_rfc2734_unit, &dir, 1);
+	if (retval < 0)
+		printf("could not update the config rom\n");
+	else if (retval == 0)
+		printf("config rom already has an RFC 2734 unit directory\n");
+	else
+		printf("config rom updated\n");
 	
-	exit(EXIT_SUCCESS);
+	exit(retval < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
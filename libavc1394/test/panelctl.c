@@ -23,6 +23,7 @@
 
 #include "../librom1394/rom1394.h"
 #include "../libavc1394/avc1394.h"
+#include "../libavc1394/avc1394_panel.h"
 
 #include <libraw1394/raw1394.h>
 #include <sys/types.h>
@@ -33,13 +34,14 @@
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 
 // Motorola DCT-6x00 IDs
 #define MOTDCT_SPEC_ID    0x00005068
 #define MOTDCT_SW_VERSION 0x00010101
 
 const char *argp_program_version =
-"panelctl  0.2";
+"panelctl  0.3";
 
 char *input;            /* the argument passed to the program */
 int verbose;              /* The -v flag */
@@ -48,6 +50,8 @@ int printcommands;	/* -c flag */
 unsigned ctl_guid;		    /* non-zero if -g flag is specified */
 unsigned ctl_spec_id;
 unsigned ctl_sw_version;
+int ctl_gap;			/* -t flag, 0 to calibrate */
+char *ctl_map;			/* -m flag, a GUID to channel map */
 
 /*
    OPTIONS.  Field 1 in ARGP.
@@ -61,6 +65,8 @@ static struct argp_option options[] =
 	{"guid",   	'g', "GUID", 0, "Specify GUID for the STB to control"},
 	{"specid",  	's', "SPEC_ID", 0, "Specify spec_id of STB to control"},
 	{"swversion", 	'n', "SW_VERSION", 0, "Specify sofware version of STB"},
+	{"gap",   	't', "MS", 0, "Milliseconds between key presses (default: measured)"},
+	{"map",   	'm', "FILE", 0, "Retune every STB listed in FILE as GUID and channel pairs"},
 	{0}
 };
 
@@ -92,6 +98,12 @@ parse_opt (int key, char *arg, struct argp_state *state)
 		case 'n' :
 			sscanf (arg, "%x", &ctl_sw_version);
 			break;
+		case 't' :
+			ctl_gap = atoi (arg);
+			break;
+		case 'm' :
+			ctl_map = arg;
+			break;
 		case ARGP_KEY_ARG:
 			if (state->arg_num != 0)
 				{
@@ -100,7 +112,7 @@ parse_opt (int key, char *arg, struct argp_state *state)
 			input = arg;
 			break;
 		case ARGP_KEY_END:
-			if (state->arg_num != 1)
+			if (state->arg_num != (ctl_map ? 0 : 1))
 				{
 				argp_usage (state);
 				}
@@ -127,6 +139,12 @@ static char doc[] =
 This program is mostly useful for a firewire tuner or set-top box with an AV interface. \
 Use it to issue a command (panelctl <command>) or to change channels on the tuner (panelctl <channel>). \
 \nTo get a list of legal commands, use the --commands switch. \
+\n\nChannels are changed with a single tune command where the device supports it, \
+otherwise by entering the digits. Key presses are paced to the device's measured \
+response time unless a gap is given with --gap. \
+\n\nTo retune many STBs at once, list them in a file with one GUID and channel per line \
+and pass it with --map instead of a channel. All STBs are found in one scan of every \
+port, changed together, and reported one per line with the time each took. \
 \n\n\
 By default, panelctl will control the first Motorola STB on the firewire chain. This will only work \
 with some Motorola STBs. To control any other STB, or to control multiple STBs, specify the GUID or both the \
@@ -144,17 +162,6 @@ Copyright (C) 2004-2009\n";
 */
 static struct argp argp = {options, parse_opt, args_doc, doc};
 
-#define CTL_CMD_PRESS AVC1394_CTYPE_CONTROL | AVC1394_SUBUNIT_TYPE_PANEL | \
-        AVC1394_SUBUNIT_ID_0 | AVC1394_PANEL_COMMAND_PASS_THROUGH | \
-        AVC1394_PANEL_OPERAND_PRESS
-
-#define CTL_CMD_RELEASE AVC1394_CTYPE_CONTROL | AVC1394_SUBUNIT_TYPE_PANEL | \
-        AVC1394_SUBUNIT_ID_0 | AVC1394_PANEL_COMMAND_PASS_THROUGH | \
-        AVC1394_PANEL_OPERAND_RELEASE
-
-#define CTL_CMD_CHANNEL AVC1394_CTYPE_CONTROL | AVC1394_SUBUNIT_TYPE_PANEL | \
-        AVC1394_SUBUNIT_ID_0 | AVC1394_PANEL_COMMAND_PASS_THROUGH | AVC1394_PANEL_OPERATION_0
-
 struct lookup_table_t
 {
 	char *string;
@@ -247,12 +254,141 @@ void doprintcommands()
 	exit(1);
 }
 
+/* one line of a channel map */
+struct map_entry {
+	octlet_t guid;
+	int channel;
+	int port;
+	avc1394_panel panel;
+};
+
+/* Retune every STB in the map at once and report how each fared */
+int retune_map(const char *file)
+{
+	FILE *f;
+	char line[256];
+	struct map_entry *map = NULL, *m;
+	avc1394_panel_tune_entry *tunes;
+	raw1394handle_t *handles;
+	rom1394_guid_index *index;
+	struct timespec start, end;
+	unsigned long long guid;
+	int channel, count = 0, found = 0, nports, port, i, j, failed;
+
+	if ((f = fopen(file, "r")) == NULL) {
+		perror("Could not open channel map");
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#' || sscanf(line, "%llx %d", &guid, &channel) != 2)
+			continue;
+		if ((m = realloc(map, (count + 1) * sizeof(struct map_entry))) == NULL) {
+			fclose(f);
+			free(map);
+			return 1;
+		}
+		map = m;
+		memset(&map[count], 0, sizeof(struct map_entry));
+		map[count].guid = guid;
+		map[count].channel = channel;
+		map[count].port = -1;
+		count++;
+	}
+	fclose(f);
+	if (count == 0) {
+		fprintf(stderr, "No GUID and channel pairs in %s.\n", file);
+		return 1;
+	}
+
+	/* a single pass over every node on every port */
+	handles = NULL;
+	nports = 0;
+	raw1394handle_t handle = raw1394_new_handle();
+	if (handle != NULL) {
+		nports = raw1394_get_port_info(handle, NULL, 0);
+		raw1394_destroy_handle(handle);
+	}
+	if (nports > 0)
+		handles = calloc(nports, sizeof(raw1394handle_t));
+	if (handles == NULL) {
+		perror("Could not get 1394 handle");
+		free(map);
+		return 1;
+	}
+	for (port = 0; port < nports && found < count; port++) {
+		if ((handles[port] = raw1394_new_handle_on_port(port)) == NULL)
+			continue;
+		if ((index = rom1394_guid_index_new(handles[port])) == NULL) {
+			fprintf(stderr, "Could not index port %d, skipping it.\n", port);
+			continue;
+		}
+		for (j = 0; j < count; j++) {
+			if (map[j].port != -1
+					|| (i = rom1394_guid_index_lookup(index, map[j].guid)) < 0)
+				continue;
+			map[j].port = port;
+			avc1394_panel_init(&map[j].panel, handles[port], i);
+			map[j].panel.press_only = 1;
+			if (ctl_gap > 0) {
+				map[j].panel.gap = ctl_gap;
+				map[j].panel.hold = ctl_gap / 2;
+			} else if (avc1394_panel_calibrate(&map[j].panel) < 0) {
+				fprintf(stderr, "0x%016llx did not respond, using %dms between keys.\n",
+					(unsigned long long) map[j].guid, map[j].panel.gap);
+			}
+			found++;
+			if (verbose)
+				printf("0x%016llx: port %d node %d\n",
+					(unsigned long long) map[j].guid, port, i);
+		}
+		rom1394_guid_index_free(index);
+	}
+
+	tunes = calloc(count, sizeof(avc1394_panel_tune_entry));
+	for (i = 0, j = 0; tunes != NULL && i < count; i++) {
+		if (map[i].port == -1)
+			continue;
+		tunes[j].panel = &map[i].panel;
+		tunes[j].channel = map[i].channel;
+		j++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	failed = tunes ? avc1394_panel_tune_all(tunes, j, 3) : -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0, j = 0; i < count; i++) {
+		if (map[i].port == -1) {
+			printf("0x%016llx: not found\n", (unsigned long long) map[i].guid);
+			continue;
+		}
+		if (tunes == NULL || failed < 0 || tunes[j].result != 0)
+			printf("0x%016llx: channel %d failed\n",
+				(unsigned long long) map[i].guid, map[i].channel);
+		else
+			printf("0x%016llx: channel %d ok in %ldms\n",
+				(unsigned long long) map[i].guid, map[i].channel, tunes[j].latency);
+		j++;
+	}
+	if (verbose)
+		printf("%d of %d retuned in %ldms\n", failed < 0 ? 0 : found - failed, count,
+			(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
+
+	for (port = 0; port < nports; port++)
+		if (handles[port] != NULL)
+			raw1394_destroy_handle(handles[port]);
+	free(handles);
+	free(tunes);
+	free(map);
+	return (found == count && failed == 0) ? 0 : 1;
+}
+
 int main (int argc, char *argv[])
 {
 	rom1394_directory dir;
 	int device = UNKNOWN;
+	avc1394_panel panel;
 
-	quadlet_t cmd[2];
+	quadlet_t cmd[3];
 	int channel;
 	int guid;
 
@@ -278,6 +414,9 @@ int main (int argc, char *argv[])
 		printf ("ARG = %s\n", input);
 		}
 
+	if (ctl_map)
+		exit (retune_map (ctl_map));
+
 	raw1394handle_t handle = raw1394_new_handle_on_port(0);
 
 	if (!handle) {
@@ -292,6 +431,21 @@ int main (int argc, char *argv[])
 
 	int nc = raw1394_get_nodecount(handle);
 	int i;
+
+	/* a GUID alone is found from the index without reading directories */
+	if (ctl_guid != 0 && !verbose) {
+		rom1394_guid_index *index = rom1394_guid_index_new(handle);
+
+		nc = index ? rom1394_guid_index_update(index) : -1;
+		for (i = 0; i < nc; ++i)
+			if ((unsigned) rom1394_guid_index_guid(index, i) == ctl_guid) {
+				device = i;
+				break;
+			}
+		if (index)
+			rom1394_guid_index_free(index);
+		nc = device == UNKNOWN ? raw1394_get_nodecount(handle) : 0;
+	}
 	for (i = 0; i < nc; ++i) {
 		if (rom1394_get_directory(handle, i, &dir) < 0) {
 			fprintf(stderr,"error reading config rom directory for node %d\n", i);
@@ -320,31 +474,34 @@ int main (int argc, char *argv[])
 		exit(1);
 	}
 
+	avc1394_panel_init(&panel, handle, device);
+	/* the DCT boxes only want the press for digits */
+	panel.press_only = 1;
+	if (ctl_gap > 0) {
+		panel.gap = ctl_gap;
+		panel.hold = ctl_gap / 2;
+	} else if (avc1394_panel_calibrate(&panel) < 0) {
+		fprintf(stderr, "Device did not respond, using %dms between keys.\n", panel.gap);
+	}
+	if (debug)
+		printf("Key gap %dms, hold %dms\n", panel.gap, panel.hold);
+
 	channel = atoi(input);
 	if ( channel )
 	{
-		int digit[3];
-		int i;
-		
-		digit[2] = (channel % 10);
-		digit[1] = (channel % 100)  / 10;
-		digit[0] = (channel % 1000) / 100;
-		
 		if (verbose)
 			printf ("Changing to channel %d on node %d.\n", channel, device);
-		if (debug)
-			printf("AV/C Command: %d%d%d = Op1=0x%08X Op2=0x%08X Op3=0x%08X\n", 
-				digit[0], digit[1], digit[2], 
-				CTL_CMD_CHANNEL | digit[0],
-				CTL_CMD_CHANNEL | digit[1], 
-				CTL_CMD_CHANNEL | digit[2]);
-		
-		for (i=0; i < 3; i++) {
-			cmd[0] = CTL_CMD_CHANNEL | digit[i];
-			cmd[1] = 0x0;
-			avc1394_transaction_block(handle, device, cmd, 2, 1);
- 			usleep(100000); // small delay for button to register
+		if (debug) {
+			unsigned char data[4] = { (channel >> 8) & 0x0f, channel & 0xff, 0, 0 };
+			avc1394_panel_build_pass_through(AVC1394_PANEL_OPERATION_TUNE_FUNCTION,
+				0, data, 4, cmd);
+			printf("AV/C Command: tune %d = Op1=0x%08X Op2=0x%08X Op3=0x%08X\n",
+				channel, cmd[0], cmd[1], cmd[2]);
 		}
+		if (avc1394_panel_tune(&panel, channel, 3) < 0)
+			fprintf(stderr, "Channel change was not accepted.\n");
+		else if (debug)
+			printf("Tuned with %s.\n", panel.tune_function == 1 ? "tune function" : "digits");
 	}
 	else
 	{
@@ -363,16 +520,11 @@ int main (int argc, char *argv[])
 			if (verbose)
 				printf ("Issuing command %s to node %d.\n", input, device);
 			if (debug) {
-				printf("AV/C Press Command: Op1=0x%08X\n", CTL_CMD_PRESS | value );
+				avc1394_panel_build_pass_through(value, 0, NULL, 0, cmd);
+				printf("AV/C Press Command: Op1=0x%08X\n", cmd[0]);
 			}
-			cmd[0] = CTL_CMD_PRESS | value;
-			cmd[1] = 0x0;
-			avc1394_transaction_block(handle, device, cmd, 2, 1);
- 			usleep(100000); // small delay for button to register
-			cmd[0] = CTL_CMD_RELEASE;
-			cmd[1] = 0x0;
-			avc1394_transaction_block(handle, device, cmd, 2, 1);
-	
+			if (avc1394_panel_key(&panel, value) != 0)
+				fprintf(stderr, "Command was not accepted.\n");
 		}
 	}
 	raw1394_destroy_handle(handle);
@@ -31,7 +31,8 @@
 int main (int argc, char *argv[])
 {
 	raw1394handle_t handle;
-	int i, length;
+	int i;
+	rom1394_bus_info info;
 	rom1394_bus_options bus_options;
 	octlet_t guid;
 	rom1394_directory dir;
@@ -63,10 +64,12 @@ int main (int argc, char *argv[])
     for (i=0; i < raw1394_get_nodecount(handle); ++i) {
         printf( "\nNode %d: \n", i);
         printf( "-------------------------------------------------\n");
-        length = rom1394_get_bus_info_block_length(handle, i);
-        printf("bus info block length = %d\n", length);
-        printf("bus id = 0x%08x\n", rom1394_get_bus_id(handle, i));
-        rom1394_get_bus_options(handle, i, &bus_options);
+        if (rom1394_get_bus_info(handle, i, &info) < 0)
+            continue;
+        bus_options = info.bus_options;
+        guid = info.guid;
+        printf("bus info block length = %d\n", info.info_length);
+        printf("bus id = 0x%08x\n", info.bus_id);
         printf("bus options:\n");
         printf("    isochronous resource manager capable: %d\n", bus_options.irmc);
         printf("    cycle master capable                : %d\n", bus_options.cmc);
@@ -74,7 +77,6 @@ int main (int argc, char *argv[])
         printf("    bus manager capable                 : %d\n", bus_options.bmc);
         printf("    cycle master clock accuracy         : %d ppm\n", bus_options.cyc_clk_acc);
         printf("    maximum asynchronous record size    : %d bytes\n", bus_options.max_rec);
-        guid = rom1394_get_guid(handle, i);
         printf("GUID: 0x%08x%08x\n", (quadlet_t) (guid>>32), (quadlet_t) (guid & 0xffffffff));
         rom1394_get_directory( handle, i, &dir);
         printf("directory:\n");
@@ -27,14 +27,46 @@ const char not_loaded[] =
 "This probably means that you don't have raw1394 support in the kernel or that\n"
 "you haven't loaded the raw1394 module.\n";
 
+static void print_rom(raw1394handle_t handle, const char *what)
+{
+	quadlet_t rom[ROM1394_MAX_SIZE];
+	size_t rom_size;
+	unsigned char rom_version;
+	int retval, i;
+
+	retval = raw1394_get_config_rom(handle, rom, sizeof(rom), &rom_size, &rom_version);
+	rom_size /= sizeof(quadlet_t);
+	printf("%s: get_config_rom returned %d, romsize %d, rom_version %d:",
+		what, retval, (int) rom_size, rom_version);
+	for (i = 0; retval == 0 && i < rom_size; i++)
+	{
+		if (i % 4 == 0) printf("\n0x%04x:", CSR_CONFIG_ROM+i*4);
+		printf(" %08x", ntohl(rom[i]));
+	}
+	printf("\n");
+}
+
+struct rom_edit {
+	rom1394_directory *dir;
+	rom1394_directory *unit;
+};
+
+/* applied to the current image, again if it changes underneath */
+static int edit_rom(quadlet_t *rom, void *data)
+{
+	struct rom_edit *edit = data;
+
+	if (rom1394_set_directory(rom, edit->dir) < 0)
+		return -1;
+	return rom1394_add_unit(rom, edit->unit);
+}
+
 int main(int argc, char **argv)
 {
 	raw1394handle_t handle;
 	int retval, i;
-	quadlet_t rom[0x100];
-	size_t rom_size;
-	unsigned char rom_version;
-	rom1394_directory dir;
+	rom1394_directory dir, unit;
+	struct rom_edit edit;
 	char *leaf;
 	
 	handle = raw1394_new_handle();
@@ -54,71 +86,35 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 	
-	/* get the current rom image */
-	retval=raw1394_get_config_rom(handle, rom, 0x100, &rom_size, &rom_version);
-	rom_size = rom1394_get_size(rom);
-	printf("get_config_rom returned %d, romsize %d, rom_version %d:",retval,rom_size,rom_version);
-	for (i = 0; i < rom_size; i++)
-	{
-		if (i % 4 == 0) printf("\n0x%04x:", CSR_CONFIG_ROM+i*4);
-		printf(" %08x", ntohl(rom[i]));
-	}
-	printf("\n");
+	print_rom(handle, "before");
 	
 	/* get the local directory */
 	rom1394_get_directory( handle, raw1394_get_local_id(handle) & 0x3f, &dir);
 	
 	/* change the vendor description for kicks */
-	i = strlen(dir.textual_leafs[0]);
-	strncpy(dir.textual_leafs[0], "Kino Rocks!                               ", i);
-	retval = rom1394_set_directory(rom, &dir);
-	printf("rom1394_set_directory returned %d, romsize %d:",retval,rom_size);
-	for (i = 0; i < rom_size; i++)
-	{
-		if (i % 4 == 0) printf("\n0x%04x:", CSR_CONFIG_ROM+i*4);
-		printf(" %08x", ntohl(rom[i]));
+	if (dir.nr_textual_leafs > 0) {
+		i = strlen(dir.textual_leafs[0]);
+		strncpy(dir.textual_leafs[0], "Kino Rocks!                               ", i);
 	}
-	printf("\n");
-	
-	/* free the allocated mem for the textual leaves */
-	rom1394_free_directory( &dir);
 	
 	/* add an AV/C unit directory */
-	dir.unit_spec_id    = 0x0000a02d;
-	dir.unit_sw_version = 0x00010001;
+	memset(&unit, 0, sizeof(unit));
+	unit.unit_spec_id    = 0x0000a02d;
+	unit.unit_sw_version = 0x00010001;
 	leaf = "avc_vcr";
-	dir.nr_textual_leafs = 1;
-	dir.textual_leafs = &leaf;
-	
-	/* manipulate the rom */
-	retval = rom1394_add_unit( rom, &dir);
+	unit.nr_textual_leafs = 1;
+	unit.textual_leafs = &leaf;
 	
-	/* get the computed size of the rom image */
-	rom_size = rom1394_get_size(rom);
+	/* manipulate and publish the rom */
+	edit.dir = &dir;
+	edit.unit = &unit;
+	retval = rom1394_publish(handle, edit_rom, &edit, 1);
+	printf("rom1394_publish returned %d\n", retval);
 	
-	printf("rom1394_add_unit_directory returned %d, romsize %d:",retval,rom_size);
-	for (i = 0; i < rom_size; i++)
-	{
-		if (i % 4 == 0) printf("\n0x%04x:", CSR_CONFIG_ROM+i*4);
-		printf(" %08x", ntohl(rom[i]));
-	}
-	printf("\n");
-	
-	/* convert computed rom size from quadlets to bytes before update */
-	rom_size *= sizeof(quadlet_t);
-	retval = raw1394_update_config_rom(handle, rom, rom_size, rom_version);
-	printf("update_config_rom returned %d\n",retval);
-	
-	retval=raw1394_get_config_rom(handle, rom, 0x100, &rom_size, &rom_version);
-	printf("get_config_rom returned %d, romsize %d, rom_version %d:",retval,rom_size,rom_version);
-	for (i = 0; i < rom_size; i++)
-	{
-		if (i % 4 == 0) printf("\n0x%04x:", CSR_CONFIG_ROM+i*4);
-		printf(" %08x", ntohl(rom[i]));
-	}
-	printf("\n");
+	/* free the allocated mem for the textual leaves */
+	rom1394_free_directory( &dir);
 	
-	printf("You need to reload your ieee1394 modules to reset the rom.\n");
+	print_rom(handle, "after");
 	
-	exit(EXIT_SUCCESS);
+	exit(retval < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }